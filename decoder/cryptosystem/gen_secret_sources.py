@@ -2,6 +2,12 @@ import json
 import sys
 from pathlib import Path
 
+from cryptography.hazmat.primitives.asymmetric.ed25519 import Ed25519PrivateKey
+
+# Shared with the firmware's secrets generator
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+from gen_decoder_secrets import ed25519_tables
+
 def gen_int_arr(a):
     return "{ " + ", ".join(map(hex, a)) + " }"
 
@@ -9,17 +15,28 @@ with open(sys.argv[1], "r") as f:
     secrets = json.load(f)
 
 channels = secrets["channels"]
+# The tests and benchmark sign with the encoder's key, to check ed25519_fixed.c
+signing_key = bytes.fromhex(secrets["signing_key"])
+pubkey = Ed25519PrivateKey.from_private_bytes(signing_key).public_key()
+pubkey = pubkey.public_bytes_raw()
 
 secrets_h = f"""
+#include "ed25519_fixed.h"
+
 #define NUM_CHANNELS {len(channels)}
 extern int channels[{len(channels)}];
+extern const uint8_t SIGNING_KEY[32];
+extern const uint8_t SK_BYTES[32];
+extern const ed25519_tables_t ED25519_TABLES;
 """
 
 secrets_c = f"""
 #include "secrets.h"
 
 int channels[NUM_CHANNELS] = {gen_int_arr(channels)};
-"""
+const uint8_t SIGNING_KEY[32] = {gen_int_arr(signing_key)};
+const uint8_t SK_BYTES[32] = {gen_int_arr(pubkey)};
+{ed25519_tables(pubkey)}"""
 
 src = Path(__file__).parent / "src"
 
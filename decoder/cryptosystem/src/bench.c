@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "wolfssl/wolfcrypt/hash.h"
+#include "wolfssl/wolfcrypt/aes.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
+#include "wolfssl/wolfcrypt/logging.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_cycles() __rdtsc()
+#else
+// no portable cycle counter, cycles/op is reported as 0
+#define read_cycles() 0
+#endif
+
+#include "cryptosystem.h"
+#include "secrets.h"
+
+#define DEFAULT_ITERATIONS 10000
+#define MAX_RESULTS 32
+
+// sizes mirror enc_frame_t in decoder/inc/decrypt.h
+#define FRAME_LEN 64
+#define NONCE_LEN 12
+#define AUTHTAG_LEN 16
+#define SIGNATURE_LEN 64
+#define FRAME_AAD_LEN (4 + sizeof(channel_id_t) + sizeof(timestamp_t) + NONCE_LEN)
+#define PACKET_LEN (FRAME_AAD_LEN + AUTHTAG_LEN + FRAME_LEN + SIGNATURE_LEN)
+
+typedef enum {
+  DIST_SEQUENTIAL,
+  DIST_RANDOM,
+  DIST_BOUNDARY,
+  DIST_NONE,
+} distribution_t;
+
+static const char *dist_names[] = { "sequential", "random", "boundary", "none" };
+
+typedef struct {
+  const char *name;
+  distribution_t dist;
+  double ns_per_op;
+  double ops_per_sec;
+  double cycles_per_op;
+  // calc_kdf_digest calls per op, for the KDF benchmarks
+  double hashes_per_op;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int n_results = 0;
+
+static int iterations = DEFAULT_ITERATIONS;
+static timestamp_t *timestamps = NULL;
+
+// keep the optimizer from dropping benchmarked calls
+static volatile uintptr_t sink;
+
+typedef struct {
+  struct timespec start;
+  uint64_t start_cycles;
+} bench_timer_t;
+
+static void timer_start(bench_timer_t *t) {
+  clock_gettime(CLOCK_MONOTONIC, &t->start);
+  t->start_cycles = read_cycles();
+}
+
+static void timer_stop(bench_timer_t *t, const char *name, distribution_t dist) {
+  struct timespec end;
+  uint64_t end_cycles = read_cycles();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - t->start.tv_sec) * 1e9 + (end.tv_nsec - t->start.tv_nsec);
+  result_t *r = &results[n_results++];
+  r->name = name;
+  r->dist = dist;
+  r->ns_per_op = ns / iterations;
+  r->ops_per_sec = 1e9 / r->ns_per_op;
+  r->cycles_per_op = (double) (end_cycles - t->start_cycles) / iterations;
+}
+
+static timestamp_t rand_ts(void) {
+  timestamp_t ts = 0;
+  for (int i = 0; i < 4; i++) {
+    ts = (ts << 16) | (rand() & 0xffff);
+  }
+  return ts;
+}
+
+// fill timestamps[] with a strictly increasing run, uniform noise, or
+// pairs straddling a random power of two boundary (no shared path below the split)
+static void gen_timestamps(distribution_t dist, timestamp_t lo, timestamp_t hi) {
+  // span wraps to 0 for the full range
+  timestamp_t span = hi - lo + 1;
+  timestamp_t ts = lo + rand_ts() % ((hi - lo) / 2 + 1);
+
+  for (int i = 0; i < iterations; i++) {
+    switch (dist) {
+      case DIST_SEQUENTIAL:
+        timestamps[i] = ts++;
+        break;
+      case DIST_RANDOM:
+        timestamps[i] = span ? lo + rand_ts() % span : rand_ts();
+        break;
+      default: {
+        int shift = KDF_ARITY_BITS * (1 + rand() % (KDF_TREE_DEPTH - 2));
+        timestamp_t boundary = (rand_ts() >> shift << shift) | ((timestamp_t) 1 << shift);
+        timestamps[i] = (i % 2) ? boundary : boundary - 1;
+        if (timestamps[i] < lo || timestamps[i] > hi) timestamps[i] = lo;
+        break;
+      }
+    }
+  }
+}
+
+void bench_kdf_digest(void) {
+  bench_timer_t t;
+  digest_t digest;
+  aeskey_t key = { .bytes = { 0x25 } };
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    calc_kdf_digest(key.bytes, sizeof(key), &digest);
+    memcpy(&key, digest.children[0], sizeof(key));
+  }
+  timer_stop(&t, "calc_kdf_digest", DIST_NONE);
+  results[n_results - 1].hashes_per_op = 1;
+  sink = key.bytes[0];
+}
+
+// the same hash through wolfCrypt's generic one-shot API, for reference
+void bench_wolfcrypt_kdf_hash(void) {
+  bench_timer_t t;
+  digest_t digest;
+  aeskey_t key = { .bytes = { 0x25 } };
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    KDF_HASH(key.bytes, sizeof(key), digest.rawDigest);
+    memcpy(&key, digest.children[0], sizeof(key));
+  }
+  timer_stop(&t, "wolfcrypt_kdf_hash", DIST_NONE);
+  results[n_results - 1].hashes_per_op = 1;
+  sink = key.bytes[0];
+}
+
+void bench_derive(distribution_t dist) {
+  bench_timer_t t;
+  kdf_cache_stats_t stats;
+  aeskey_t key;
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x25 } } };
+
+  gen_timestamps(dist, 0, UINT64_MAX);
+
+  // worst case: a full subscription is one root node, KDF_TREE_DEPTH levels above every frame
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    derive_node_subkey(&root, timestamps[i], &key);
+  }
+  timer_stop(&t, "derive_node_subkey", dist);
+  results[n_results - 1].hashes_per_op = KDF_TREE_DEPTH;
+
+  invalidate_kdf_cache(1);
+  reset_kdf_cache_stats();
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    derive_node_subkey_cached(1, &root, timestamps[i], &key);
+  }
+  timer_stop(&t, "derive_node_subkey_cached", dist);
+  get_kdf_cache_stats(&stats);
+  results[n_results - 1].hashes_per_op = (double) stats.digests / iterations;
+  sink = key.bytes[0];
+}
+
+void bench_find_parent(distribution_t dist) {
+  static subscription_t sub;
+  static subscription_index_t index;
+  bench_timer_t t;
+  kdf_node_t *node = NULL;
+
+  // [1, 2^64 - 2] needs the most nodes, SUBSCRIPTION_MAX_NODES
+  cover_subscription(&sub, 1, UINT64_MAX - 1);
+  build_subscription_index(&sub, &index);
+  gen_timestamps(dist, 1, UINT64_MAX - 1);
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    node = find_ts_parent(&sub, timestamps[i]);
+  }
+  timer_stop(&t, "find_ts_parent", dist);
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    node = find_ts_parent_indexed(&sub, &index, timestamps[i]);
+  }
+  timer_stop(&t, "find_ts_parent_indexed", dist);
+  sink = (uintptr_t) node;
+}
+
+// mirrors decrypt_frame(): key setup and decryption of one 64 byte frame
+void bench_aes_gcm(void) {
+  bench_timer_t t;
+  Aes ctx;
+  uint8_t key[KEY_LEN] = { 0x25 };
+  uint8_t nonce[NONCE_LEN] = { 0 };
+  uint8_t aad[FRAME_AAD_LEN] = { '%', 'D' };
+  uint8_t tag[AUTHTAG_LEN];
+  uint8_t frame[FRAME_LEN] = { 0 };
+  uint8_t ciphertext[FRAME_LEN];
+  int ret = 0;
+
+  wc_AesGcmSetKey(&ctx, key, sizeof(key));
+  wc_AesGcmEncrypt(&ctx, ciphertext, frame, sizeof(frame), nonce, sizeof(nonce), tag, sizeof(tag), aad, sizeof(aad));
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    wc_AesGcmSetKey(&ctx, key, sizeof(key));
+    ret |= wc_AesGcmDecrypt(&ctx, frame, ciphertext, sizeof(ciphertext), nonce, sizeof(nonce), tag, sizeof(tag), aad, sizeof(aad));
+  }
+  timer_stop(&t, "aes_gcm_decrypt_frame", DIST_NONE);
+
+  if (ret != 0) {
+    fprintf(stderr, "error: AES-GCM decryption failed\n");
+    exit(1);
+  }
+}
+
+// mirrors verify_packet() on a full size decode packet, with wolfCrypt's generic
+// verifier as it was and with the encoder key's build-time tables as it is now
+void bench_ed25519(void) {
+  bench_timer_t t;
+  ed25519_key key;
+  uint8_t packet[PACKET_LEN] = { '%', 'D' };
+  uint8_t signature[SIGNATURE_LEN];
+  word32 sig_len = sizeof(signature);
+  int verified = 1;
+
+  wc_ed25519_init(&key);
+  wc_ed25519_import_private_key(SIGNING_KEY, ED25519_KEY_SIZE, SK_BYTES, ED25519_PUB_KEY_SIZE, &key);
+  wc_ed25519_sign_msg(packet, PACKET_LEN - SIGNATURE_LEN, signature, &sig_len, &key);
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    int ok = 0;
+    wc_ed25519_verify_msg(signature, sig_len, packet, PACKET_LEN - SIGNATURE_LEN, &ok, &key);
+    verified &= ok;
+  }
+  timer_stop(&t, "ed25519_verify_packet", DIST_NONE);
+  wc_ed25519_free(&key);
+
+  timer_start(&t);
+  for (int i = 0; i < iterations; i++) {
+    verified &= ed25519_fixed_verify(&ED25519_TABLES, SK_BYTES, signature, packet,
+                                     PACKET_LEN - SIGNATURE_LEN) == 0;
+  }
+  timer_stop(&t, "ed25519_fixed_verify_packet", DIST_NONE);
+
+  if (!verified) {
+    fprintf(stderr, "error: Ed25519 verification failed\n");
+    exit(1);
+  }
+}
+
+// subscription size for the tree shape this was built with: the worst case
+// cover, and the mean over random ranges
+static int max_sub_nodes = SUBSCRIPTION_MAX_NODES;
+static double mean_sub_nodes = 0;
+static int max_sub_bytes = 0;
+static int max_compact_sub_bytes = 0;
+
+void bench_subscription_size(void) {
+  static subscription_t sub;
+  long total = 0;
+
+  cover_subscription(&sub, 1, UINT64_MAX - 1);
+  max_sub_nodes = sub.n_nodes;
+  max_sub_bytes = SUBSCRIPTION_HEADER_LEN + sub.n_nodes * sizeof(kdf_node_t);
+  max_compact_sub_bytes = compact_subscription(&sub);
+
+  for (int i = 0; i < iterations; i++) {
+    timestamp_t start = rand_ts();
+    cover_subscription(&sub, start, start + rand_ts() % (UINT64_MAX - start));
+    total += sub.n_nodes;
+  }
+  mean_sub_nodes = (double) total / iterations;
+}
+
+void print_table(void) {
+  printf("kdf tree: arity %d, depth %d, subscription nodes %d max (%d bytes, %d compact), %.1f mean\n\n",
+         KDF_ARITY, (int) KDF_TREE_DEPTH, max_sub_nodes, max_sub_bytes, max_compact_sub_bytes, mean_sub_nodes);
+  printf("%-28s %-12s %14s %14s %14s %10s\n", "benchmark", "timestamps", "ns/op", "ops/s", "cycles/op", "hashes/op");
+  for (int i = 0; i < n_results; i++) {
+    result_t *r = &results[i];
+    printf("%-28s %-12s %14.1f %14.1f %14.1f %10.2f\n", r->name, dist_names[r->dist], r->ns_per_op, r->ops_per_sec, r->cycles_per_op, r->hashes_per_op);
+  }
+}
+
+int write_json(const char *path) {
+  FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(f, "{\n  \"iterations\": %d,\n", iterations);
+  fprintf(f, "  \"kdf\": {\"arity\": %d, \"depth\": %d, \"max_subscription_nodes\": %d, \"max_subscription_bytes\": %d, \"max_compact_subscription_bytes\": %d, \"mean_subscription_nodes\": %.3f},\n",
+          KDF_ARITY, (int) KDF_TREE_DEPTH, max_sub_nodes, max_sub_bytes, max_compact_sub_bytes, mean_sub_nodes);
+  fprintf(f, "  \"results\": [\n");
+  for (int i = 0; i < n_results; i++) {
+    result_t *r = &results[i];
+    fprintf(f, "    {\"name\": \"%s\", \"distribution\": \"%s\", \"ns_per_op\": %.3f, \"ops_per_sec\": %.3f, \"cycles_per_op\": %.3f, \"hashes_per_op\": %.3f}%s\n",
+            r->name, dist_names[r->dist], r->ns_per_op, r->ops_per_sec, r->cycles_per_op, r->hashes_per_op, i + 1 < n_results ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+
+  if (f != stdout) fclose(f);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *json_path = NULL;
+  int dist_mask = (1 << DIST_SEQUENTIAL) | (1 << DIST_RANDOM) | (1 << DIST_BOUNDARY);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:d:j:")) != -1) {
+    switch (opt) {
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+      case 'd':
+        dist_mask = 0;
+        for (int d = 0; d < DIST_NONE; d++) {
+          if (strcmp(optarg, dist_names[d]) == 0) dist_mask = 1 << d;
+        }
+        break;
+      case 'j':
+        json_path = optarg;
+        break;
+      default:
+        dist_mask = 0;
+    }
+  }
+
+  if (iterations <= 0 || dist_mask == 0) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-d sequential|random|boundary] [-j out.json|-]\n", argv[0]);
+    return 1;
+  }
+
+  if (wolfCrypt_Init() != 0) {
+    WOLFSSL_MSG("wolfCrypt_Init() error");
+  }
+
+  timestamps = calloc(iterations, sizeof(*timestamps));
+  if (timestamps == NULL) {
+    fprintf(stderr, "error: out of memory\n");
+    return 1;
+  }
+  srand(0x25);
+
+  bench_subscription_size();
+  bench_kdf_digest();
+  bench_wolfcrypt_kdf_hash();
+  for (int d = 0; d < DIST_NONE; d++) {
+    if (!(dist_mask & (1 << d))) continue;
+    bench_derive(d);
+    bench_find_parent(d);
+  }
+  bench_aes_gcm();
+  bench_ed25519();
+
+  // keep stdout parseable when the JSON goes there
+  if (json_path == NULL || strcmp(json_path, "-") != 0) {
+    print_table();
+  }
+  if (json_path != NULL && write_json(json_path) != 0) {
+    return 1;
+  }
+
+  free(timestamps);
+  if (wolfCrypt_Cleanup() != 0) {
+    WOLFSSL_MSG("wolfCrypt_Cleanup() error");
+  }
+  return 0;
+}
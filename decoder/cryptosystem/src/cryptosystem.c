@@ -11,8 +11,200 @@
 #include "wolfssl/wolfcrypt/hash.h"
 #include <string.h>
 
+#define TIMESTAMP_BITS (sizeof(timestamp_t) * 8)
+
+// which child of the level `level` node the path to ts descends into
+#define KDF_DIGIT(ts, level) (((ts) >> (KDF_ARITY_BITS * (KDF_TREE_DEPTH - 1 - (level)))) & (KDF_ARITY - 1))
+
+static kdf_cache_t kdf_cache[KDF_CACHE_SLOTS] = {0};
+static uint8_t kdf_cache_victim = 0;
+static kdf_cache_stats_t kdf_cache_stats = {0};
+
+// The binary tree only ever hashes one 16 byte key, so it gets a dedicated
+// SHA-256 (define KDF_WOLFCRYPT_HASH to always go through wolfCrypt instead)
+#if KDF_ARITY_BITS == 1 && !defined(KDF_WOLFCRYPT_HASH)
+#define KDF_SHA256_BLOCK
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_S0(x) (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define SHA256_S1(x) (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define SHA256_s0(x) (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+#define SHA256_CH(x, y, z) ((((y) ^ (z)) & (x)) ^ (z))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define SHA256_H0 ((uint32_t) 0x6a09e667)
+#define SHA256_H1 ((uint32_t) 0xbb67ae85)
+#define SHA256_H2 ((uint32_t) 0x3c6ef372)
+#define SHA256_H3 ((uint32_t) 0xa54ff53a)
+#define SHA256_H4 ((uint32_t) 0x510e527f)
+#define SHA256_H5 ((uint32_t) 0x9b05688c)
+#define SHA256_H6 ((uint32_t) 0x1f83d9ab)
+#define SHA256_H7 ((uint32_t) 0x5be0cd19)
+
+// The one block is the key, then constant padding: w[4] is the 0x80 byte,
+// w[5..14] are zero and w[15] is the message length in bits
+#define KDF_W4 ((uint32_t) 0x80000000)
+#define KDF_W15 ((uint32_t) (KEY_LEN * 8))
+
+// Round 0 starts from the IV, so everything but its message word is constant
+#define KDF_ROUND0_T1 ((uint32_t) (SHA256_H7 + SHA256_S1(SHA256_H4) + SHA256_CH(SHA256_H4, SHA256_H5, SHA256_H6) + 0x428a2f98))
+#define KDF_ROUND0_T2 ((uint32_t) (SHA256_S0(SHA256_H0) + SHA256_MAJ(SHA256_H0, SHA256_H1, SHA256_H2)))
+
+#define SHA256_ROUND(kw) do { \
+    uint32_t t1 = h + SHA256_S1(e) + SHA256_CH(e, f, g) + (kw); \
+    uint32_t t2 = SHA256_S0(a) + SHA256_MAJ(a, b, c); \
+    h = g; g = f; f = e; e = d + t1; \
+    d = c; c = b; b = a; a = t1 + t2; \
+  } while (0)
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// SHA-256 of exactly one KEY_LEN byte message, i.e. a single compression
+// with the padding, length and the schedule terms that only depend on them
+// folded in, straight into both child keys
+static void kdf_sha256(const uint8_t *in, uint8_t *out) {
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h;
+
+  for (int i = 0; i < 4; i++) {
+    w[i] = ((uint32_t) in[4 * i] << 24) | ((uint32_t) in[4 * i + 1] << 16) |
+           ((uint32_t) in[4 * i + 2] << 8) | in[4 * i + 3];
+  }
+
+  // w[t] = s1(w[t-2]) + w[t-7] + s0(w[t-15]) + w[t-16], minus the zero terms
+  w[16] = SHA256_s0(w[1]) + w[0];
+  w[17] = SHA256_s1(KDF_W15) + SHA256_s0(w[2]) + w[1];
+  w[18] = SHA256_s1(w[16]) + SHA256_s0(w[3]) + w[2];
+  w[19] = SHA256_s1(w[17]) + SHA256_s0(KDF_W4) + w[3];
+  w[20] = SHA256_s1(w[18]) + KDF_W4;
+  w[21] = SHA256_s1(w[19]);
+  w[22] = SHA256_s1(w[20]) + KDF_W15;
+  w[23] = SHA256_s1(w[21]) + w[16];
+  for (int t = 24; t < 30; t++) {
+    w[t] = SHA256_s1(w[t - 2]) + w[t - 7];
+  }
+  w[30] = SHA256_s1(w[28]) + w[23] + SHA256_s0(KDF_W15);
+  w[31] = SHA256_s1(w[29]) + w[24] + SHA256_s0(w[16]) + KDF_W15;
+  for (int t = 32; t < 64; t++) {
+    w[t] = SHA256_s1(w[t - 2]) + w[t - 7] + SHA256_s0(w[t - 15]) + w[t - 16];
+  }
+
+  uint32_t t1 = KDF_ROUND0_T1 + w[0];
+  a = t1 + KDF_ROUND0_T2; b = SHA256_H0; c = SHA256_H1; d = SHA256_H2;
+  e = SHA256_H3 + t1; f = SHA256_H4; g = SHA256_H5; h = SHA256_H6;
+
+  for (int t = 1; t < 4; t++) {
+    SHA256_ROUND(sha256_k[t] + w[t]);
+  }
+  SHA256_ROUND(sha256_k[4] + KDF_W4);
+  for (int t = 5; t < 15; t++) {
+    SHA256_ROUND(sha256_k[t]);
+  }
+  SHA256_ROUND(sha256_k[15] + KDF_W15);
+  for (int t = 16; t < 64; t++) {
+    SHA256_ROUND(sha256_k[t] + w[t]);
+  }
+
+  uint32_t state[8] = {
+    a + SHA256_H0, b + SHA256_H1, c + SHA256_H2, d + SHA256_H3,
+    e + SHA256_H4, f + SHA256_H5, g + SHA256_H6, h + SHA256_H7,
+  };
+  for (int i = 0; i < 8; i++) {
+    out[4 * i] = state[i] >> 24;
+    out[4 * i + 1] = state[i] >> 16;
+    out[4 * i + 2] = state[i] >> 8;
+    out[4 * i + 3] = state[i];
+  }
+}
+
+#endif
+
 int calc_kdf_digest(const byte *in, word32 len, digest_t *digest) {
-  return wc_Sha256Hash(in, len, (byte*) &digest->rawDigest);
+#ifdef KDF_SHA256_BLOCK
+  if (len == KEY_LEN) {
+    kdf_sha256(in, digest->rawDigest);
+    return 0;
+  }
+#endif
+  return KDF_HASH(in, len, (byte*) &digest->rawDigest);
+}
+
+// set node to the first node of the minimal cover of [start, end] (start <= end),
+// the largest aligned block at start that stays within end, and return the last
+// timestamp below it. Only the node's level and index are touched
+static timestamp_t cover_first_node(timestamp_t start, timestamp_t end, kdf_node_t *node) {
+  // grow the block a level at a time (width counts timestamp bits below the node)
+  unsigned int width = 0;
+  while (width < TIMESTAMP_BITS && ((start >> width) & (KDF_ARITY - 1)) == 0) {
+    timestamp_t last = start + ((((timestamp_t) KDF_ARITY) << width) - 1);
+    if (last < start || last > end) break;
+    width += KDF_ARITY_BITS;
+  }
+
+  node->level = KDF_TREE_DEPTH - width / KDF_ARITY_BITS;
+  node->index = width == TIMESTAMP_BITS ? 0 : start >> width;
+  return width == TIMESTAMP_BITS ? UINT64_MAX : start + ((((timestamp_t) 1) << width) - 1);
+}
+
+// set the positions of nodes[0..n_nodes) to the minimal cover of [start, end],
+// in the same order as Tree.minimal_positions, leaving their keys alone. With
+// check, the positions have to be that already. Returns 0 if the cover has
+// exactly n_nodes nodes (and they matched), -1 otherwise
+int cover_nodes(kdf_node_t *nodes, uint8_t n_nodes, timestamp_t start, timestamp_t end, bool check) {
+  kdf_node_t node;
+  timestamp_t curr = start;
+
+  if (start > end) return -1;
+
+  for (int i = 0; i < n_nodes; i++) {
+    timestamp_t last = cover_first_node(curr, end, &node);
+    if (check && (nodes[i].level != node.level || nodes[i].index != node.index)) return -1;
+    nodes[i].level = node.level;
+    nodes[i].index = node.index;
+
+    if (last >= end) return i + 1 == n_nodes ? 0 : -1;
+    curr = last + 1;
+  }
+  return -1;
+}
+
+// bring a subscription update of len bytes into the full form in place, from
+// either the full form (checking its nodes are the minimal cover, so that it
+// compacts losslessly) or the compact form. The buffer has to have room for
+// the full form
+int expand_subscription(subscription_t *sub, uint16_t len) {
+  if (len < SUBSCRIPTION_HEADER_LEN || sub->n_nodes > SUBSCRIPTION_MAX_NODES) return -1;
+
+  if (len == SUBSCRIPTION_HEADER_LEN + sub->n_nodes * sizeof(kdf_node_t)) {
+    return cover_nodes(sub->nodes, sub->n_nodes, sub->start, sub->end, true);
+  }
+  if (len != SUBSCRIPTION_HEADER_LEN + sub->n_nodes * sizeof(aeskey_t)) return -1;
+
+  // spread the keys out, last first so none is overwritten before it moves
+  for (int i = sub->n_nodes - 1; i >= 0; i--) {
+    memmove(&sub->nodes[i].key, &sub->keys[i], sizeof(aeskey_t));
+  }
+  return cover_nodes(sub->nodes, sub->n_nodes, sub->start, sub->end, false);
+}
+
+// squeeze a full subscription whose nodes are the minimal cover down to the
+// compact form in place, returning its length
+uint16_t compact_subscription(subscription_t *sub) {
+  // keys[i] ends before nodes[i + 1] starts, so first to last is safe
+  for (int i = 0; i < sub->n_nodes; i++) {
+    memmove(&sub->keys[i], &sub->nodes[i].key, sizeof(aeskey_t));
+  }
+  return SUBSCRIPTION_HEADER_LEN + sub->n_nodes * sizeof(aeskey_t);
 }
 
 #ifdef _DECODER_POC
@@ -29,51 +221,327 @@ subscription_t *find_subscription(SubscriptionPool *pool, channel_id_t channel)
   return NULL;
 }
 
+// fill sub with the (unkeyed) minimal set of nodes covering [start, end],
+// in the same order as Tree.minimal_positions
+void cover_subscription(subscription_t *sub, timestamp_t start, timestamp_t end) {
+  timestamp_t curr = start;
+
+  memset(sub, 0, sizeof(*sub));
+  sub->start = start;
+  sub->end = end;
+
+  while (sub->n_nodes < SUBSCRIPTION_MAX_NODES) {
+    timestamp_t last = cover_first_node(curr, end, &sub->nodes[sub->n_nodes++]);
+    if (last >= end) break;
+    curr = last + 1;
+  }
+}
+
 #endif
 
+// first and last timestamps below a node
+// (shifting by the full width is undefined, so the root is special-cased)
+static timestamp_t node_start(const kdf_node_t *node) {
+  if (node->level == 0) return 0;
+  return node->index << (KDF_ARITY_BITS * (KDF_TREE_DEPTH - node->level));
+}
+
+static timestamp_t node_end(const kdf_node_t *node) {
+  if (node->level == 0) return UINT64_MAX;
+  return ((node->index + 1) << (KDF_ARITY_BITS * (KDF_TREE_DEPTH - node->level))) - 1;
+}
+
 // find which node within our subscription is a parent of ts
 kdf_node_t *find_ts_parent(subscription_t *sub, timestamp_t ts) {
   kdf_node_t *node;
-  timestamp_t start, end;
 
   if (sub->n_nodes <= SUBSCRIPTION_MAX_NODES) {
     for (int i = 0; i < sub->n_nodes; i++) {
       node = &sub->nodes[i];
-      start = node->index << (KDF_TREE_DEPTH - node->level);
-      if (ts < start) continue;
-      end = ((node->index + 1) << (KDF_TREE_DEPTH - node->level)) - 1;
-      if (ts > end) continue;
+      if (ts < node_start(node)) continue;
+      if (ts > node_end(node)) continue;
       return node;
     }
   }
   return NULL;
 }
 
-// derive key from node that is a parent for ts
-int derive_node_subkey(const kdf_node_t *parent, timestamp_t ts, aeskey_t *out_key) {
-  kdf_node_t curr = *parent;
+// precompute sorted bounds of n_nodes nodes, for find_ts_entry to bisect
+int build_index_entries(const kdf_node_t *nodes, uint8_t n_nodes, kdf_index_entry_t *entries) {
+  kdf_index_entry_t entry;
+  int j;
+
+  if (n_nodes > SUBSCRIPTION_MAX_NODES) {
+    return -1;
+  }
+
+  // Nodes usually arrive in order already, so insertion sort is ~linear
+  for (int i = 0; i < n_nodes; i++) {
+    const kdf_node_t *node = &nodes[i];
+    if (node->level > KDF_TREE_DEPTH) {
+      return -1;
+    }
+
+    entry.start = node_start(node);
+    entry.end = node_end(node);
+    entry.node = i;
+
+    for (j = i; j > 0 && entries[j - 1].start > entry.start; j--) {
+      entries[j] = entries[j - 1];
+    }
+    entries[j] = entry;
+  }
+
+  return 0;
+}
+
+// precompute sorted node bounds so find_ts_parent_indexed can bisect
+int build_subscription_index(const subscription_t *sub, subscription_index_t *index) {
+  memset(index, 0, sizeof(*index));
+  if (build_index_entries(sub->nodes, sub->n_nodes, index->entries) != 0) {
+    memset(index, 0, sizeof(*index));
+    return -1;
+  }
+
+  index->n_entries = sub->n_nodes;
+  return 0;
+}
+
+// find the position of the node that is a parent of ts by bisecting sorted
+// index entries, or -1 if no entry covers ts
+int find_ts_entry(const kdf_index_entry_t *entries, uint8_t n_entries, timestamp_t ts) {
+  // Find the last entry starting at or before ts
+  int lo = 0;
+  int hi = n_entries <= SUBSCRIPTION_MAX_NODES ? n_entries : 0;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (entries[mid].start <= ts) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == 0) return -1;
+  const kdf_index_entry_t *entry = &entries[lo - 1];
+  if (ts > entry->end) return -1;
+  return entry->node;
+}
+
+// find the position of the node that is a parent of ts by bisecting the index,
+// or -1 if no indexed node covers ts
+int find_ts_index(const subscription_index_t *index, timestamp_t ts) {
+  return find_ts_entry(index->entries, index->n_entries, ts);
+}
+
+// find which node within our subscription is a parent of ts, using its index
+kdf_node_t *find_ts_parent_indexed(subscription_t *sub, const subscription_index_t *index, timestamp_t ts) {
+  // An index that doesn't describe this subscription is ignored
+  if (index->n_entries != sub->n_nodes) {
+    return find_ts_parent(sub, ts);
+  }
+
+  int node = find_ts_index(index, ts);
+  if (node < 0 || node >= sub->n_nodes) return NULL;
+  return &sub->nodes[node];
+}
+
+// derive the key of the node at (level, index) from one of its ancestors
+int derive_node_key(const kdf_node_t *ancestor, uint8_t level, uint64_t index, aeskey_t *out_key) {
+  kdf_node_t curr = *ancestor;
   digest_t digest = {0};
 
-  while (curr.level < KDF_TREE_DEPTH) {
+  if (level > KDF_TREE_DEPTH || curr.level > level) {
+    return -1;
+  }
+  // (level, index) has to be below the ancestor, checked on the shared prefix
+  // (shifting by the full width is undefined, and every node is below the root)
+  if (curr.level > 0 && (index >> (KDF_ARITY_BITS * (level - curr.level))) != curr.index) {
+    return -1;
+  }
+
+  while (curr.level < level) {
     int ret = calc_kdf_digest((byte*) &curr.key.bytes, sizeof(curr.key), &digest);
     if (ret != 0) {
       return -1;
     }
 
-    // Decide to go left or right...
-    timestamp_t start = curr.index << (KDF_TREE_DEPTH - curr.level);
-    timestamp_t end = ((curr.index + 1) << (KDF_TREE_DEPTH - curr.level)) - 1;
+    // Decide which child to descend into, based on the index digit for this level
+    unsigned int child = (index >> (KDF_ARITY_BITS * (level - 1 - curr.level))) & (KDF_ARITY - 1);
+    curr.index = KDF_ARITY * curr.index + child;
+    memcpy(&curr.key, digest.children[child], sizeof(curr.key));
     curr.level += 1;
-    // If timestamp is closer to start, descend left
-    if (ts - start < end - ts) {
-      curr.index = 2 * curr.index;
-      memcpy(&curr.key, digest.left, sizeof(digest.left));
-    } else {
-      curr.index = 2 * curr.index + 1;
-      memcpy(&curr.key, digest.right, sizeof(digest.left));
-    }
   }
 
   memcpy(out_key->bytes, &curr.key, sizeof(out_key->bytes));
   return 0;
 }
+
+// derive key from node that is a parent for ts
+int derive_node_subkey(const kdf_node_t *parent, timestamp_t ts, aeskey_t *out_key) {
+  return derive_node_key(parent, KDF_TREE_DEPTH, ts, out_key);
+}
+
+// find the cached path for channel, evicting another channel's if needed
+static kdf_cache_t *get_kdf_cache(channel_id_t channel) {
+  for (int i = 0; i < KDF_CACHE_SLOTS; i++) {
+    if (kdf_cache[i].channel == channel) return &kdf_cache[i];
+  }
+
+  kdf_cache_t *cache = &kdf_cache[kdf_cache_victim];
+  kdf_cache_victim = (kdf_cache_victim + 1) % KDF_CACHE_SLOTS;
+  memset(cache, 0, sizeof(*cache));
+  cache->channel = channel;
+  return cache;
+}
+
+// find the cached path for channel without evicting anything, NULL if none
+static kdf_cache_t *find_kdf_cache(channel_id_t channel) {
+  for (int i = 0; i < KDF_CACHE_SLOTS; i++) {
+    if (kdf_cache[i].channel == channel) return &kdf_cache[i];
+  }
+  return NULL;
+}
+
+// number of leading digits shared by two timestamps,
+// i.e. the level of their deepest common ancestor
+static uint8_t common_level(timestamp_t a, timestamp_t b) {
+  timestamp_t diff = a ^ b;
+  if (diff == 0) return KDF_TREE_DEPTH;
+  return __builtin_clzll(diff) / KDF_ARITY_BITS;
+}
+
+// start deriving the key for ts from a node that is a parent for it, reusing
+// the part of the channel's last derived path that is shared with ts
+// (only reads the cache, so it is safe to begin before the request is verified)
+int kdf_walk_begin(kdf_walk_t *walk, channel_id_t channel, const kdf_node_t *parent, timestamp_t ts) {
+  kdf_cache_t *cache = find_kdf_cache(channel);
+  uint8_t level = parent->level;
+
+  walk->active = false;
+  if (parent->level > KDF_TREE_DEPTH) {
+    return -1;
+  }
+
+  // Only reuse the path if it hangs from the very same node, and as far down
+  // as it was derived
+  uint8_t common = 0;
+  if (cache != NULL && cache->valid) {
+    common = common_level(cache->ts, ts);
+    if (common > cache->depth) common = cache->depth;
+  }
+  if (common > level && memcmp(&cache->parent, parent, sizeof(*parent)) == 0) {
+    memcpy(&walk->path[level], &cache->path[level], (common - level + 1) * sizeof(aeskey_t));
+    level = common;
+    kdf_cache_stats.hits++;
+  } else {
+    memcpy(&walk->path[level], &parent->key, sizeof(parent->key));
+    kdf_cache_stats.misses++;
+  }
+
+  walk->active = true;
+  walk->channel = channel;
+  walk->parent = *parent;
+  walk->ts = ts;
+  walk->level = level;
+  return 0;
+}
+
+// make the walk's path so far the channel's cached path
+static void kdf_walk_store(kdf_walk_t *walk) {
+  kdf_cache_t *cache = get_kdf_cache(walk->channel);
+  uint8_t from = walk->parent.level;
+
+  cache->parent = walk->parent;
+  memcpy(&cache->path[from], &walk->path[from], (walk->level - from + 1) * sizeof(aeskey_t));
+  cache->ts = walk->ts;
+  cache->depth = walk->level;
+  cache->valid = true;
+  walk->active = false;
+}
+
+// derive one more level of the path to ts,
+// returns 1 once the leaf is reached, 0 if levels remain, -1 on error
+int kdf_walk_step(kdf_walk_t *walk) {
+  digest_t digest = {0};
+
+  if (!walk->active) {
+    return -1;
+  }
+  if (walk->level >= KDF_TREE_DEPTH) {
+    return 1;
+  }
+
+  int ret = calc_kdf_digest(walk->path[walk->level].bytes, sizeof(walk->path[walk->level]), &digest);
+  if (ret != 0) {
+    walk->active = false;
+    return -1;
+  }
+  kdf_cache_stats.digests++;
+
+  memcpy(&walk->path[walk->level + 1], digest.children[KDF_DIGIT(walk->ts, walk->level)], sizeof(aeskey_t));
+  walk->level++;
+
+  return walk->level == KDF_TREE_DEPTH;
+}
+
+// derive whatever is left of the path to ts and output the leaf key
+int kdf_walk_finish(kdf_walk_t *walk, aeskey_t *out_key) {
+  int ret;
+
+  do {
+    ret = kdf_walk_step(walk);
+  } while (ret == 0);
+  if (ret < 0) {
+    return -1;
+  }
+
+  kdf_walk_store(walk);
+  memcpy(out_key->bytes, &walk->path[KDF_TREE_DEPTH], sizeof(out_key->bytes));
+  return 0;
+}
+
+// stop a walk short of the leaf, keeping the levels derived so far for the
+// next walk on the channel to pick up
+void kdf_walk_suspend(kdf_walk_t *walk) {
+  if (walk->active) {
+    kdf_walk_store(walk);
+  }
+}
+
+// derive key from node that is a parent for ts, reusing the part of the
+// channel's last derived path that is shared with ts
+int derive_node_subkey_cached(channel_id_t channel, const kdf_node_t *parent, timestamp_t ts, aeskey_t *out_key) {
+  // static rather than a kilobyte of stack; nothing calls this reentrantly
+  static kdf_walk_t walk;
+
+  if (kdf_walk_begin(&walk, channel, parent, ts) != 0) {
+    return -1;
+  }
+  return kdf_walk_finish(&walk, out_key);
+}
+
+// drop (and wipe) the cached path for a channel
+void invalidate_kdf_cache(channel_id_t channel) {
+  for (int i = 0; i < KDF_CACHE_SLOTS; i++) {
+    if (kdf_cache[i].channel == channel) {
+      memset(&kdf_cache[i], 0, sizeof(kdf_cache[i]));
+      kdf_cache[i].channel = channel;
+    }
+  }
+}
+
+void get_kdf_cache_stats(kdf_cache_stats_t *out) {
+  *out = kdf_cache_stats;
+}
+
+void reset_kdf_cache_stats(void) {
+  memset(&kdf_cache_stats, 0, sizeof(kdf_cache_stats));
+}
+
+#ifdef _KDF_LIB
+// lets the python design check the library was built for the same tree
+uint8_t kdf_arity_bits(void) {
+  return KDF_ARITY_BITS;
+}
+#endif
@@ -10,13 +10,17 @@
 #ifndef _CRYPTOSYSTEM_H
 #define _CRYPTOSYSTEM_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "wolfssl/wolfcrypt/hash.h"
 
-#ifdef _DECODER_POC
+#if defined(_DECODER_POC)
 #define BODY_LEN 4096
 #include "secrets.h"
+#elif defined(_KDF_LIB)
+// host shared library for the python design (see design/ectf25_design/kdf_native.py)
+#define BODY_LEN 4096
 #else
 #include "messaging.h"
 #endif
@@ -24,14 +28,41 @@
 typedef uint64_t timestamp_t;
 typedef uint32_t channel_id_t;
 
-// n depth tree can store 2^n nodes
-// ...therefore depth = bitcount of the type
-#define KDF_TREE_DEPTH sizeof(timestamp_t) * 8
-// worst case = 2 nodes per level, minus the top level
-#define SUBSCRIPTION_MAX_NODES 2 * KDF_TREE_DEPTH - 2
+// log2 of the number of children per KDF tree node: 1 is the binary SHA-256
+// tree, 2 a 4-ary tree where one SHA-512 digest yields all four child keys.
+// Must match ARITY_BITS in design/ectf25_design/cryptosystem.py
+#ifndef KDF_ARITY_BITS
+#define KDF_ARITY_BITS 1
+#endif
+#define KDF_ARITY (1 << KDF_ARITY_BITS)
+
+// n depth tree can store ARITY^n nodes
+// ...therefore depth = bitcount of the type / bits per level
+#define KDF_TREE_DEPTH (sizeof(timestamp_t) * 8 / KDF_ARITY_BITS)
+// worst case = ARITY - 1 nodes per side per level, and ARITY - 2 under the root
+#define SUBSCRIPTION_MAX_NODES (2 * (KDF_ARITY - 1) * (KDF_TREE_DEPTH - 1) + KDF_ARITY - 2)
+
+#define KEY_LEN 16
+#define KDF_DIGEST_SIZE (KEY_LEN * KDF_ARITY)
+
+#if KDF_ARITY_BITS == 1
+#define KDF_HASH wc_Sha256Hash
+_Static_assert(KDF_DIGEST_SIZE == SHA256_DIGEST_SIZE, "SHA-256 yields two child keys");
+#elif KDF_ARITY_BITS == 2
+#define KDF_HASH wc_Sha512Hash
+_Static_assert(KDF_DIGEST_SIZE == SHA512_DIGEST_SIZE, "SHA-512 yields four child keys");
+#else
+#error "KDF_ARITY_BITS must be 1 (binary tree) or 2 (4-ary tree)"
+#endif
 
-#define KDF_DIGEST_SIZE SHA256_DIGEST_SIZE
-#define KEY_LEN (KDF_DIGEST_SIZE / 2)
+// one cached path per channel we can decode at once
+#ifdef _DECODER_POC
+#define KDF_CACHE_SLOTS NUM_CHANNELS
+#else
+// more channels than this can be subscribed, but decoding more at once just
+// evicts paths round robin
+#define KDF_CACHE_SLOTS 9
+#endif
 
 #pragma pack(push, 1)
 
@@ -42,10 +73,8 @@ typedef struct aeskey
 
 typedef union
 {
-  struct {
-    uint8_t left[sizeof(aeskey_t)];
-    uint8_t right[sizeof(aeskey_t)];
-  };
+  // children[i] is the key of the node's i-th child, left to right
+  uint8_t children[KDF_ARITY][sizeof(aeskey_t)];
   byte rawDigest[KDF_DIGEST_SIZE];
 } digest_t;
 
@@ -62,11 +91,58 @@ typedef union {
     timestamp_t start;
     timestamp_t end;
     uint8_t n_nodes;
-    kdf_node_t nodes[SUBSCRIPTION_MAX_NODES];
+    union {
+      kdf_node_t nodes[SUBSCRIPTION_MAX_NODES];
+      // compact form: only the keys, as the positions follow from [start, end]
+      aeskey_t keys[SUBSCRIPTION_MAX_NODES];
+    };
   };
   uint8_t rawBytes[BODY_LEN];
 } subscription_t;
 
+#define SUBSCRIPTION_HEADER_LEN offsetof(subscription_t, nodes)
+
+// timestamp bounds of one subscription node, kept sorted by start
+typedef struct
+{
+  timestamp_t start;
+  timestamp_t end;
+  // position of the node in subscription_t.nodes
+  uint8_t node;
+} kdf_index_entry_t;
+
+// lookup table stored alongside a subscription's nodes
+typedef struct
+{
+  uint8_t n_entries;
+  kdf_index_entry_t entries[SUBSCRIPTION_MAX_NODES];
+} subscription_index_t;
+
+// last derived root-to-leaf path for a channel
+typedef struct
+{
+  bool valid;
+  channel_id_t channel;
+  // subscription node the cached path hangs from
+  kdf_node_t parent;
+  // timestamp of the last derived leaf
+  timestamp_t ts;
+  // deepest level of path derived for ts, short of the leaf if a walk was suspended
+  uint8_t depth;
+  // path[l] is the key of the level l node on the way to ts
+  aeskey_t path[KDF_TREE_DEPTH + 1];
+} kdf_cache_t;
+
+typedef struct
+{
+  // derivations that reused at least one cached level below the parent
+  uint32_t hits;
+  // derivations that had to start over from the parent
+  uint32_t misses;
+  // calc_kdf_digest calls made by the cached derivation path
+  uint32_t digests;
+} kdf_cache_stats_t;
+
 #ifdef _DECODER_POC
 typedef struct
 {
@@ -77,15 +153,53 @@ typedef struct
 
 #pragma pack(pop)
 
+// a cached derivation in progress, advanced one level at a time in its own
+// copy of the path; the channel's cache only takes it on kdf_walk_finish() or
+// kdf_walk_suspend(), so a walk that is dropped leaves the cache as it was
+typedef struct
+{
+  bool active;
+  channel_id_t channel;
+  kdf_node_t parent;
+  timestamp_t ts;
+  uint8_t level;
+  // path[l] for l from parent.level to level is the walk's path so far
+  aeskey_t path[KDF_TREE_DEPTH + 1];
+} kdf_walk_t;
+
 #ifdef _DECODER_POC
 void init_pool(SubscriptionPool *pool);
 subscription_t *find_subscription(SubscriptionPool *pool, channel_id_t channel);
+void cover_subscription(subscription_t *sub, timestamp_t start, timestamp_t end);
 #endif
 
 int calc_kdf_digest(const byte *in, word32 len, digest_t *out);
 
+int cover_nodes(kdf_node_t *nodes, uint8_t n_nodes, timestamp_t start, timestamp_t end, bool check);
+int expand_subscription(subscription_t *sub, uint16_t len);
+uint16_t compact_subscription(subscription_t *sub);
+
 kdf_node_t *find_ts_parent(subscription_t *sub, timestamp_t ts);
+int build_index_entries(const kdf_node_t *nodes, uint8_t n_nodes, kdf_index_entry_t *entries);
+int build_subscription_index(const subscription_t *sub, subscription_index_t *index);
+int find_ts_entry(const kdf_index_entry_t *entries, uint8_t n_entries, timestamp_t ts);
+int find_ts_index(const subscription_index_t *index, timestamp_t ts);
+kdf_node_t *find_ts_parent_indexed(subscription_t *sub, const subscription_index_t *index, timestamp_t ts);
 
+int derive_node_key(const kdf_node_t *ancestor, uint8_t level, uint64_t index, aeskey_t *out_key);
 int derive_node_subkey(const kdf_node_t *ts_node, timestamp_t ts, aeskey_t *out_key);
 
+int derive_node_subkey_cached(channel_id_t channel, const kdf_node_t *ts_node, timestamp_t ts, aeskey_t *out_key);
+int kdf_walk_begin(kdf_walk_t *walk, channel_id_t channel, const kdf_node_t *ts_node, timestamp_t ts);
+int kdf_walk_step(kdf_walk_t *walk);
+int kdf_walk_finish(kdf_walk_t *walk, aeskey_t *out_key);
+void kdf_walk_suspend(kdf_walk_t *walk);
+void invalidate_kdf_cache(channel_id_t channel);
+void get_kdf_cache_stats(kdf_cache_stats_t *out);
+void reset_kdf_cache_stats(void);
+
+#ifdef _KDF_LIB
+uint8_t kdf_arity_bits(void);
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wolfssl/wolfcrypt/hash.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
+#include "wolfssl/wolfcrypt/logging.h"
+
+#include "cryptosystem.h"
+#include "secrets.h"
+
+#define N_SEQUENTIAL 1000
+#define N_RANDOM 100
+
+static int failures = 0;
+
+static timestamp_t rand_ts(void) {
+  timestamp_t ts = 0;
+  for (int i = 0; i < 4; i++) {
+    ts = (ts << 16) | (rand() & 0xffff);
+  }
+  return ts;
+}
+
+// node at `level` that is a parent of ts, keyed from root
+static void make_parent(const kdf_node_t *root, uint8_t level, timestamp_t ts, kdf_node_t *out) {
+  *out = *root;
+  out->level = level;
+  out->index = level ? ts >> (KDF_ARITY_BITS * (KDF_TREE_DEPTH - level)) : 0;
+}
+
+static void check(channel_id_t channel, const kdf_node_t *parent, timestamp_t ts) {
+  aeskey_t want = {0};
+  aeskey_t got = {0};
+
+  if (derive_node_subkey(parent, ts, &want) != 0 ||
+      derive_node_subkey_cached(channel, parent, ts, &got) != 0) {
+    fprintf(stderr, "FAIL: derivation error for channel %u ts %lu\n", channel, ts);
+    failures++;
+    return;
+  }
+
+  if (memcmp(&want, &got, sizeof(want)) != 0) {
+    fprintf(stderr, "FAIL: key mismatch for channel %u ts %lu (parent level %u)\n", channel, ts, parent->level);
+    failures++;
+  }
+}
+
+void test_indexed_parent(void) {
+  static subscription_t sub;
+  static subscription_index_t index;
+
+  printf("running test_indexed_parent(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    timestamp_t start = rand_ts();
+    timestamp_t end = start + (rand_ts() % (UINT64_MAX - start));
+    cover_subscription(&sub, start, end);
+
+    if (build_subscription_index(&sub, &index) != 0) {
+      fprintf(stderr, "FAIL: could not index [%lu, %lu]\n", start, end);
+      failures++;
+      continue;
+    }
+
+    // the cover has to be exact, whatever the tree's arity
+    if (find_ts_parent(&sub, start) == NULL || find_ts_parent(&sub, end) == NULL ||
+        (start > 0 && find_ts_parent(&sub, start - 1) != NULL) ||
+        (end < UINT64_MAX && find_ts_parent(&sub, end + 1) != NULL)) {
+      fprintf(stderr, "FAIL: cover of [%lu, %lu] is not exact\n", start, end);
+      failures++;
+    }
+
+    timestamp_t probes[] = {
+      start, end, start - 1, end + 1,
+      start + (rand_ts() % (end - start + 1)), rand_ts(),
+    };
+    for (size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); p++) {
+      if (find_ts_parent_indexed(&sub, &index, probes[p]) != find_ts_parent(&sub, probes[p])) {
+        fprintf(stderr, "FAIL: parent mismatch for ts %lu in [%lu, %lu]\n", probes[p], start, end);
+        failures++;
+      }
+    }
+  }
+
+  // the whole timestamp range is covered by the root alone
+  cover_subscription(&sub, 0, UINT64_MAX);
+  build_subscription_index(&sub, &index);
+  if (sub.n_nodes != 1 || find_ts_parent_indexed(&sub, &index, UINT64_MAX) != &sub.nodes[0]) {
+    fprintf(stderr, "FAIL: root subscription not found\n");
+    failures++;
+  }
+
+  // and [1, 2^64 - 2] needs the most nodes
+  cover_subscription(&sub, 1, UINT64_MAX - 1);
+  if (sub.n_nodes != SUBSCRIPTION_MAX_NODES) {
+    fprintf(stderr, "FAIL: worst case cover has %u nodes, not %d\n", sub.n_nodes, (int) SUBSCRIPTION_MAX_NODES);
+    failures++;
+  }
+}
+
+void test_compact_subscription(void) {
+  static subscription_t want;
+  static subscription_t sub;
+
+  printf("running test_compact_subscription(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    timestamp_t start = i ? rand_ts() : 1;
+    timestamp_t end = i ? start + (rand_ts() % (UINT64_MAX - start)) : UINT64_MAX - 1;
+    cover_subscription(&want, start, end);
+    for (int n = 0; n < want.n_nodes; n++) {
+      want.nodes[n].key.bytes[0] = n;
+      want.nodes[n].key.bytes[KEY_LEN - 1] = rand();
+    }
+    uint16_t full_len = SUBSCRIPTION_HEADER_LEN + want.n_nodes * sizeof(kdf_node_t);
+
+    // full updates are taken as they are, and compact ones grow back into them
+    sub = want;
+    uint16_t len = compact_subscription(&sub);
+    if (len != SUBSCRIPTION_HEADER_LEN + want.n_nodes * KEY_LEN || expand_subscription(&sub, len) != 0 ||
+        memcmp(&sub, &want, full_len) != 0) {
+      fprintf(stderr, "FAIL: compact round trip of [%lu, %lu]\n", start, end);
+      failures++;
+    }
+    sub = want;
+    if (expand_subscription(&sub, full_len) != 0 || memcmp(&sub, &want, full_len) != 0) {
+      fprintf(stderr, "FAIL: full subscription of [%lu, %lu] not taken as is\n", start, end);
+      failures++;
+    }
+
+    // a full update whose nodes aren't the minimal cover can't be compacted
+    sub = want;
+    sub.nodes[rand() % sub.n_nodes].index ^= 1;
+    if (expand_subscription(&sub, full_len) == 0) {
+      fprintf(stderr, "FAIL: moved node accepted in [%lu, %lu]\n", start, end);
+      failures++;
+    }
+
+    // nor can a compact one with the wrong number of keys, or an inverted range
+    sub = want;
+    len = compact_subscription(&sub);
+    sub.n_nodes++;
+    if (expand_subscription(&sub, len + KEY_LEN) == 0) {
+      fprintf(stderr, "FAIL: extra key accepted in [%lu, %lu]\n", start, end);
+      failures++;
+    }
+    sub = want;
+    len = compact_subscription(&sub);
+    sub.start = end + 1;
+    if (end < UINT64_MAX && expand_subscription(&sub, len) == 0) {
+      fprintf(stderr, "FAIL: inverted range accepted\n");
+      failures++;
+    }
+  }
+}
+
+void test_kdf_digest(void) {
+  uint8_t key[KEY_LEN];
+  byte want[KDF_DIGEST_SIZE];
+  digest_t got;
+
+  // the KDF's own hash has to agree with wolfCrypt's, down to every child key
+  printf("running test_kdf_digest(%d)\n", N_SEQUENTIAL);
+  for (int i = 0; i < N_SEQUENTIAL; i++) {
+    for (size_t j = 0; j < sizeof(key); j++) {
+      key[j] = i < 2 ? -i : rand();
+    }
+
+    if (KDF_HASH(key, sizeof(key), want) != 0 || calc_kdf_digest(key, sizeof(key), &got) != 0 ||
+        memcmp(want, got.rawDigest, sizeof(want)) != 0) {
+      fprintf(stderr, "FAIL: kdf digest mismatch on iteration %d\n", i);
+      failures++;
+    }
+  }
+}
+
+void test_sequential(void) {
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x01 } } };
+  timestamp_t ts = rand_ts();
+
+  printf("running test_sequential(%d)\n", N_SEQUENTIAL);
+  for (int i = 0; i < N_SEQUENTIAL; i++) {
+    check(1, &root, ts);
+    ts += 1 + (rand() % 8);
+  }
+}
+
+void test_random(void) {
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x02 } } };
+
+  printf("running test_random(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    check(1, &root, rand_ts());
+  }
+}
+
+void test_subtree_parents(void) {
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x03 } } };
+  kdf_node_t parent;
+
+  printf("running test_subtree_parents(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    timestamp_t ts = rand_ts();
+    make_parent(&root, rand() % KDF_TREE_DEPTH, ts, &parent);
+    check(2, &parent, ts);
+    // a sibling timestamp under the same parent should reuse the path
+    check(2, &parent, ts ^ 1);
+  }
+}
+
+void test_interleaved_channels(void) {
+  kdf_node_t roots[KDF_CACHE_SLOTS + 1];
+  timestamp_t ts = rand_ts();
+
+  printf("running test_interleaved_channels(%d)\n", N_SEQUENTIAL);
+  for (int c = 0; c <= KDF_CACHE_SLOTS; c++) {
+    roots[c] = (kdf_node_t){ .level = 0, .index = 0, .key = { .bytes = { 0x10, c } } };
+  }
+
+  // more channels than slots, so entries get evicted along the way
+  for (int i = 0; i < N_SEQUENTIAL; i++) {
+    int c = rand() % (KDF_CACHE_SLOTS + 1);
+    check(c, &roots[c], ts);
+    ts += 1 + (rand() % 4);
+  }
+
+  invalidate_kdf_cache(0);
+  check(0, &roots[0], ts);
+}
+
+void test_stepped_walks(void) {
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x04 } } };
+  kdf_walk_t walk;
+  aeskey_t want = {0};
+  aeskey_t got = {0};
+  timestamp_t ts = rand_ts();
+
+  printf("running test_stepped_walks(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    ts += 1 + (rand() % 1024);
+
+    // advance a few levels at a time, like the decoder does as bytes arrive
+    if (kdf_walk_begin(&walk, 3, &root, ts) != 0) {
+      fprintf(stderr, "FAIL: kdf_walk_begin for ts %lu\n", ts);
+      failures++;
+      continue;
+    }
+    int steps = rand() % (KDF_TREE_DEPTH + 4);
+    for (int s = 0; s < steps && kdf_walk_step(&walk) == 0; s++);
+
+    // an abandoned walk must not leave a path that later walks trust
+    if (i % 4 == 3) {
+      kdf_walk_begin(&walk, 3, &root, rand_ts());
+      kdf_walk_step(&walk);
+      check(3, &root, ts);
+      continue;
+    }
+
+    // a suspended walk leaves its levels for the next one, at ts or nearby
+    if (i % 4 == 2) {
+      kdf_walk_suspend(&walk);
+      check(3, &root, ts + (rand() % 2) * (rand() % 1024));
+      continue;
+    }
+
+    derive_node_subkey(&root, ts, &want);
+    if (kdf_walk_finish(&walk, &got) != 0 || memcmp(&want, &got, sizeof(want)) != 0) {
+      fprintf(stderr, "FAIL: stepped walk mismatch for ts %lu after %d steps\n", ts, steps);
+      failures++;
+    }
+  }
+}
+
+void test_dropped_walks(void) {
+  kdf_node_t root = { .level = 0, .index = 0, .key = { .bytes = { 0x05 } } };
+  kdf_node_t forged = { .level = 0, .index = 0, .key = { .bytes = { 0x66 } } };
+  kdf_walk_t walk;
+  kdf_cache_stats_t before, after;
+  timestamp_t ts = rand_ts();
+
+  printf("running test_dropped_walks(%d)\n", N_RANDOM);
+  for (int i = 0; i < N_RANDOM; i++) {
+    ts += 1 + (rand() % 1024);
+    check(5, &root, ts);
+
+    // a walk begun on an unverified request and then dropped, whether from
+    // another parent or for another channel, must leave the cached path alone
+    kdf_walk_begin(&walk, i % 2 ? 5 : 100 + i, &forged, rand_ts());
+    for (int s = rand() % (KDF_TREE_DEPTH + 4); s > 0 && kdf_walk_step(&walk) == 0; s--);
+
+    get_kdf_cache_stats(&before);
+    check(5, &root, ts + 1);
+    get_kdf_cache_stats(&after);
+    if (after.misses != before.misses) {
+      fprintf(stderr, "FAIL: dropped walk wiped the cached path on iteration %d\n", i);
+      failures++;
+    }
+  }
+}
+
+// the order L of the Ed25519 base point, little endian
+static const uint8_t GROUP_ORDER[32] = {
+  0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+};
+
+static int fixed_verify(const uint8_t *sig, const uint8_t *msg, size_t len) {
+  return ed25519_fixed_verify(&ED25519_TABLES, SK_BYTES, sig, msg, len);
+}
+
+void test_ed25519_fixed(void) {
+  ed25519_key key;
+  uint8_t msg[256];
+  uint8_t sig[ED25519_SIG_LEN];
+  uint8_t bad[ED25519_SIG_LEN];
+  word32 sig_len;
+
+  printf("running test_ed25519_fixed(%d)\n", N_RANDOM);
+  if (ed25519_fixed_check(&ED25519_TABLES, SK_BYTES) != 0) {
+    fprintf(stderr, "FAIL: tables do not match the public key\n");
+    failures++;
+    return;
+  }
+
+  wc_ed25519_init(&key);
+  wc_ed25519_import_private_key(SIGNING_KEY, ED25519_KEY_SIZE, SK_BYTES, ED25519_PUB_KEY_SIZE, &key);
+  for (int i = 0; i < N_RANDOM; i++) {
+    size_t len = rand() % sizeof(msg);
+    for (size_t j = 0; j < len; j++) {
+      msg[j] = rand();
+    }
+    sig_len = sizeof(sig);
+    wc_ed25519_sign_msg(msg, len, sig, &sig_len, &key);
+
+    if (fixed_verify(sig, msg, len) != 0) {
+      fprintf(stderr, "FAIL: valid signature rejected on iteration %d\n", i);
+      failures++;
+    }
+
+    // any flipped bit in R or s has to be caught
+    memcpy(bad, sig, sizeof(bad));
+    bad[rand() % sizeof(bad)] ^= 1 << (rand() % 8);
+    if (fixed_verify(bad, msg, len) == 0) {
+      fprintf(stderr, "FAIL: tampered signature accepted on iteration %d\n", i);
+      failures++;
+    }
+
+    // and so does s + L, which would pass the group equation
+    memcpy(bad, sig, sizeof(bad));
+    for (int j = 0, carry = 0; j < 32; j++) {
+      carry += bad[32 + j] + GROUP_ORDER[j];
+      bad[32 + j] = carry;
+      carry >>= 8;
+    }
+    if (fixed_verify(bad, msg, len) == 0) {
+      fprintf(stderr, "FAIL: non-canonical s accepted on iteration %d\n", i);
+      failures++;
+    }
+
+    if (len > 0) {
+      msg[rand() % len] ^= 1;
+      if (fixed_verify(sig, msg, len) == 0) {
+        fprintf(stderr, "FAIL: tampered message accepted on iteration %d\n", i);
+        failures++;
+      }
+    }
+  }
+  wc_ed25519_free(&key);
+}
+
+int main(void) {
+  kdf_cache_stats_t stats;
+
+  if (wolfCrypt_Init() != 0) {
+    WOLFSSL_MSG("wolfCrypt_Init() error");
+  }
+
+  srand(0x25);
+  reset_kdf_cache_stats();
+
+  test_kdf_digest();
+  test_sequential();
+  test_random();
+  test_subtree_parents();
+  test_interleaved_channels();
+  test_indexed_parent();
+  test_compact_subscription();
+  test_stepped_walks();
+  test_dropped_walks();
+  test_ed25519_fixed();
+
+  get_kdf_cache_stats(&stats);
+  printf("kdf cache: %u hits, %u misses, %u digests\n", stats.hits, stats.misses, stats.digests);
+
+  if (wolfCrypt_Cleanup() != 0) {
+    WOLFSSL_MSG("wolfCrypt_Cleanup() error");
+  }
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
@@ -9,10 +9,102 @@ import sys
 SECRETS_FILE = "src/secrets.c"
 KEY_LEN = 16
 
+# Ed25519 verification tables, see ED25519_TABLE_WINDOW in inc/ed25519_fixed.h
+TABLE_WINDOW = 6
+TABLE_POINTS = 1 << (TABLE_WINDOW - 2)
+HALF_BITS = 128
+
+# Curve25519 in twisted Edwards form, -x^2 + y^2 = 1 + d x^2 y^2 mod P
+P = 2**255 - 19
+D = -121665 * pow(121666, P - 2, P) % P
+
+
+def recover_x(y, sign):
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P)
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P != 0:
+        x = x * pow(2, (P - 1) // 4, P) % P
+    if (x * x - x2) % P != 0:
+        raise ValueError("not a curve point")
+    return P - x if x & 1 != sign else x
+
+
+BASE_Y = 4 * pow(5, P - 2, P) % P
+BASE = (recover_x(BASE_Y, 0), BASE_Y)
+
+
+def point_add(a, b):
+    (x1, y1), (x2, y2) = a, b
+    t = D * x1 * x2 * y1 * y2
+    x3 = (x1 * y2 + y1 * x2) * pow(1 + t, P - 2, P)
+    y3 = (y1 * y2 + x1 * x2) * pow(1 - t, P - 2, P)
+    return (x3 % P, y3 % P)
+
+
+def point_mul(k, a):
+    r = (0, 1)
+    while k:
+        if k & 1:
+            r = point_add(r, a)
+        a = point_add(a, a)
+        k >>= 1
+    return r
+
+
+def decode_point(encoded):
+    y = int.from_bytes(encoded, "little")
+    return (recover_x(y & ((1 << 255) - 1), y >> 255), y & ((1 << 255) - 1))
+
+
+def fe_words(v):
+    words = ((v >> (32 * i)) & 0xFFFFFFFF for i in range(8))
+    return "{" + ",".join(f"0x{w:08x}" for w in words) + "}"
+
+
+def precomp_table(point):
+    """
+    ed25519_precomp_t entries for point, 3 * point, ..., (2 * TABLE_POINTS - 1) * point
+    """
+    entries = []
+    double = point_add(point, point)
+    for _ in range(TABLE_POINTS):
+        x, y = point
+        entries.append(
+            "{"
+            + ",".join(
+                fe_words(v) for v in ((y + x) % P, (y - x) % P, 2 * D * x * y % P)
+            )
+            + "}"
+        )
+        point = point_add(point, double)
+    return "{" + ",\n    ".join(entries) + "}"
+
+
+def ed25519_tables(pubkey_bytes):
+    """
+    Returns C source for the ed25519_tables_t of a public key.
+    """
+    x, y = decode_point(pubkey_bytes)
+    neg_key = ((P - x) % P, y)
+    tables = {
+        "base": BASE,
+        "base_hi": point_mul(1 << HALF_BITS, BASE),
+        "neg_key": neg_key,
+        "neg_key_hi": point_mul(1 << HALF_BITS, neg_key),
+    }
+    src = "#if ED25519_FIXED_TABLES\n"
+    src += f"_Static_assert(ED25519_TABLE_POINTS == {TABLE_POINTS}, "
+    src += '"ED25519_TABLE_WINDOW does not match gen_decoder_secrets.py");\n'
+    src += "const ed25519_tables_t ED25519_TABLES = {\n"
+    for name, point in tables.items():
+        src += f"  .{name} = {precomp_table(point)},\n"
+    return src + "};\n#endif\n"
+
 
 def write_header():
     with open(SECRETS_FILE, "w") as f:
-        f.write('#include "cryptosystem.h"\n\n')
+        f.write('#include "cryptosystem.h"\n')
+        f.write('#include "ed25519_fixed.h"\n\n')
 
 
 def gen_subscription_key(decoder_id, secrets):
@@ -40,6 +132,15 @@ def write_ch0(secrets):
         f.write("} } };\n")
 
 
+def write_arity(secrets):
+    # Secrets from before the tree shape was recorded are for the binary tree
+    arity_bits = secrets.get("kdf_arity_bits", 1)
+
+    with open(SECRETS_FILE, "a") as f:
+        f.write(f"_Static_assert(KDF_ARITY_BITS == {arity_bits}, ")
+        f.write(f'"build with KDF_ARITY_BITS={arity_bits}, as the secrets were");\n')
+
+
 def write_pubkey(secrets):
     privkey_bytes = bytes.fromhex(secrets["signing_key"])
     privkey = Ed25519PrivateKey.from_private_bytes(privkey_bytes)
@@ -50,6 +151,7 @@ def write_pubkey(secrets):
         f.write("const uint8_t SK_BYTES[32] = {")
         f.write(",".join([f"0x{b:02x}" for b in pubkey_bytes]))
         f.write("};\n")
+        f.write(ed25519_tables(pubkey_bytes))
 
 
 if __name__ == "__main__":
@@ -66,6 +168,7 @@ if __name__ == "__main__":
         )
     secrets = json.load(open(secrets_file, "rb"))
     write_header()
+    write_arity(secrets)
     gen_subscription_key(decoder_id, secrets)
     write_ch0(secrets)
     write_pubkey(secrets)
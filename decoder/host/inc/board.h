@@ -0,0 +1,8 @@
+/**
+ * @file "board.h"
+ * @author MIT TechSec
+ * @brief Host stand-in for the MSDK header of the same name (intentionally empty)
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
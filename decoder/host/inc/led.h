@@ -0,0 +1,20 @@
+/**
+ * @file "led.h"
+ * @author MIT TechSec
+ * @brief Host stand-in for the board LED driver, all LEDs are no-ops
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _HOST_LED_H
+#define _HOST_LED_H
+
+#define LED1 0
+#define LED2 1
+#define LED3 2
+
+#define LED_On(led) ((void)(led))
+#define LED_Off(led) ((void)(led))
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file "mpu_armv7.h"
+ * @author MIT TechSec
+ * @brief Host stand-in for the CMSIS ARMv7 MPU API, all region setup is a no-op
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _HOST_MPU_ARMV7_H
+#define _HOST_MPU_ARMV7_H
+
+// Arguments are never expanded, so the CMSIS constants need no definitions
+#define ARM_MPU_SetRegionEx(...) ((void)0)
+#define ARM_MPU_Enable(...) ((void)0)
+
+#endif
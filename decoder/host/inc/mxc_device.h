@@ -0,0 +1,26 @@
+/**
+ * @file "mxc_device.h"
+ * @author MIT TechSec
+ * @brief Host stand-ins for the MAX78000 device definitions used by the Decoder
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _HOST_MXC_DEVICE_H
+#define _HOST_MXC_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define E_NO_ERROR 0
+
+// Flash geometry of the MAX78000
+#define MXC_FLASH_MEM_BASE 0x10000000
+#define MXC_FLASH_PAGE_SIZE 0x2000
+
+// There is only one clock on the host, so selecting one always succeeds
+#define MXC_SYS_CLOCK_IPO 0
+#define MXC_SYS_Clock_Select(clock) ((void)(clock), E_NO_ERROR)
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ * @file "uart.h"
+ * @author MIT TechSec
+ * @brief Host stand-in for the MSDK UART driver header
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _HOST_UART_H
+#define _HOST_UART_H
+
+#include "mxc_device.h"
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file "host_cycles.c"
+ * @author MIT TechSec
+ * @brief Host replacement for simple_cycles.c, counting nanoseconds
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#define _GNU_SOURCE
+#include "simple_cycles.h"
+
+#include <time.h>
+
+/** @brief Starts the cycle counter.
+ * 
+ *  The monotonic clock is always running, so there is nothing to do.
+*/
+void cycles_init(void) {
+}
+
+/** @brief Reads the cycle counter.
+ * 
+ *  @note The counter wraps around, so only the difference between two
+ *      readings is meaningful.
+ *  @return The monotonic clock in nanoseconds, truncated to 32 bits.
+*/
+uint32_t cycles_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/** @brief Counter ticks per microsecond.
+ * 
+ *  @return 1000, as the counter counts nanoseconds.
+*/
+uint32_t cycles_per_us(void) {
+    return 1000;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file "host_flash.c"
+ * @author MIT TechSec
+ * @brief Host replacement for simple_flash.c, backed by an mmap'd file
+ * @date 2025
+ *
+ * The file is mapped at the same address as the Decoder's persistent pages
+ * on the MAX78000, so code that dereferences flash addresses directly
+ * (e.g. the subscription slots) works unchanged.
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#define _GNU_SOURCE
+#include "simple_flash.h"
+#include "mxc_device.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// First boot flag page through the end of the subscription pages
+#define HOST_FLASH_START 0x10040000
+#define HOST_FLASH_SIZE 0x40000
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+// Page erase time to stall for, and whether to log erases, from
+// DECODER_FLASH_ERASE_US and DECODER_FLASH_STATS
+static long erase_us = 0;
+static bool log_erases = false;
+static uint32_t erase_count = 0;
+static uint64_t write_bytes = 0;
+
+#define IN_FLASH(address, size) \
+    ((address) >= HOST_FLASH_START && (size) <= HOST_FLASH_SIZE && \
+     (address) - HOST_FLASH_START <= HOST_FLASH_SIZE - (size))
+
+/**
+ * @brief Initialize the Simple Flash Interface
+ * 
+ * Maps DECODER_FLASH (default "decoder_flash.bin") over the persistent
+ * pages, creating it erased if it doesn't exist yet.
+*/
+void flash_simple_init(void) {
+    struct stat st;
+    const char * path = getenv("DECODER_FLASH");
+    if (path == NULL) {
+        path = "decoder_flash.bin";
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("decoder: could not open flash file");
+        exit(1);
+    }
+
+    bool fresh = st.st_size < HOST_FLASH_SIZE;
+    if (fresh && ftruncate(fd, HOST_FLASH_SIZE) != 0) {
+        perror("decoder: could not size flash file");
+        exit(1);
+    }
+
+    void * flash = mmap((void *)HOST_FLASH_START, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (flash != (void *)HOST_FLASH_START) {
+        fprintf(stderr, "decoder: could not map flash file at 0x%x\n", HOST_FLASH_START);
+        exit(1);
+    }
+    close(fd);
+
+    // New flash comes out of the factory erased
+    if (fresh) {
+        memset(flash, 0xff, HOST_FLASH_SIZE);
+    }
+
+    const char * us = getenv("DECODER_FLASH_ERASE_US");
+    if (us != NULL) {
+        erase_us = strtol(us, NULL, 0);
+    }
+    log_erases = getenv("DECODER_FLASH_STATS") != NULL;
+}
+
+/**
+ * @brief Flash Simple Erase Page
+ * 
+ * @param address: uint32_t, address of flash page to erase
+ * 
+ * @return int: return negative if failure, zero if success
+*/
+int flash_simple_erase_page(uint32_t address) {
+    address &= ~(MXC_FLASH_PAGE_SIZE - 1);
+    if (!IN_FLASH(address, MXC_FLASH_PAGE_SIZE)) {
+        return -1;
+    }
+
+    memset((void *)(uintptr_t)address, 0xff, MXC_FLASH_PAGE_SIZE);
+
+    erase_count++;
+    if (log_erases) {
+        fprintf(stderr, "decoder: flash erase 0x%08x (%u erases, %llu bytes written)\n",
+                address, erase_count, (unsigned long long)write_bytes);
+    }
+    if (erase_us > 0) {
+        struct timespec stall = { .tv_sec = erase_us / 1000000, .tv_nsec = (erase_us % 1000000) * 1000 };
+        while (nanosleep(&stall, &stall) != 0);
+    }
+    return 0;
+}
+
+/**
+ * @brief Flash Simple Read
+ * 
+ * @param address: uint32_t, address of flash page to read
+ * @param buffer: void*, pointer to buffer for data to be read into
+ * @param size: uint32_t, number of bytes to read from flash
+*/
+void flash_simple_read(uint32_t address, void* buffer, uint32_t size) {
+    if (IN_FLASH(address, size)) {
+        memcpy(buffer, (void *)(uintptr_t)address, size);
+    }
+}
+
+/**
+ * @brief Flash Simple Write
+ * 
+ * @param address: uint32_t, address of flash page to write
+ * @param buffer: void*, pointer to buffer to write data from
+ * @param size: uint32_t, number of bytes to write from flash
+ *
+ * @return int: return negative if failure, zero if success
+ *
+ * Like real flash, bits can only be cleared (1->0) without an erase.
+*/
+int flash_simple_write(uint32_t address, void* buffer, uint32_t size) {
+    if (!IN_FLASH(address, size)) {
+        return -1;
+    }
+
+    uint8_t * dst = (uint8_t *)(uintptr_t)address;
+    uint8_t * src = buffer;
+    for (uint32_t i = 0; i < size; i++) {
+        dst[i] &= src[i];
+    }
+    write_bytes += size;
+    return 0;
+}
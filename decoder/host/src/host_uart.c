@@ -0,0 +1,237 @@
+/**
+ * @file "host_uart.c"
+ * @author MIT TechSec
+ * @brief Host replacement for simple_uart.c, backed by a pty or stdin/stdout
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#define _GNU_SOURCE
+#include "simple_uart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UART_BUF_LEN 256
+
+static int uart_in = -1;
+static int uart_out = -1;
+
+static uint8_t rx_buf[UART_BUF_LEN];
+static size_t rx_len = 0;
+static size_t rx_pos = 0;
+
+static uint8_t tx_buf[UART_BUF_LEN];
+static size_t tx_len = 0;
+
+// Time one byte takes on the wire at DECODER_BAUD (8N1), 0 to not pace reads
+static uint64_t byte_ns = 0;
+// When the last received byte finished arriving
+static uint64_t rx_wire_ns = 0;
+
+/** @brief Read the monotonic clock.
+ * 
+ *  @return uint64_t: nanoseconds.
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** @brief Hold back the next received byte until it would have arrived over a real UART.
+ * 
+ *  Bytes queued behind the previous one arrive back to back, so firmware work
+ *  done between reads overlaps with the transfer just like on the board.
+ * 
+ *  @param waited: bool, Whether the byte only just arrived after a blocking read.
+ */
+static void pace_rx(bool waited) {
+    if (byte_ns == 0) {
+        return;
+    }
+
+    uint64_t now = now_ns();
+    if (waited && rx_wire_ns < now) {
+        rx_wire_ns = now;
+    }
+    rx_wire_ns += byte_ns;
+
+    struct timespec until = { .tv_sec = rx_wire_ns / 1000000000, .tv_nsec = rx_wire_ns % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+/** @brief Write out any buffered bytes.
+ */
+static void uart_drain(void) {
+    size_t sent = 0;
+
+    while (sent < tx_len) {
+        ssize_t ret = write(uart_out, tx_buf + sent, tx_len - sent);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("decoder: uart write");
+            exit(1);
+        }
+        sent += ret;
+    }
+    tx_len = 0;
+}
+
+/** @brief Open a pty for the host tools to connect to, in place of the board's serial port.
+ * 
+ *  @return int: master side fd, negative if error.
+ */
+static int open_pty(void) {
+    struct termios tio;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        return -1;
+    }
+
+    const char * name = ptsname(master);
+    if (name == NULL) {
+        return -1;
+    }
+
+    // Hold the slave open ourselves, so that the host tools closing and
+    // reopening the port doesn't hang up the master, and make it raw
+    int slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+        return -1;
+    }
+    cfmakeraw(&tio);
+    if (tcsetattr(slave, TCSANOW, &tio) != 0) {
+        return -1;
+    }
+
+    const char * link = getenv("DECODER_PTY_LINK");
+    if (link != NULL) {
+        unlink(link);
+        if (symlink(name, link) != 0) {
+            return -1;
+        }
+        name = link;
+    }
+
+    fprintf(stderr, "decoder: UART on %s\n", name);
+    return master;
+}
+
+/** @brief Initializes the UART transport.
+ * 
+ *  DECODER_UART=stdio uses stdin/stdout, otherwise a pty is opened
+ *  (optionally symlinked to DECODER_PTY_LINK). DECODER_BAUD paces received
+ *  bytes to that baud rate.
+ * 
+ *  @note This function should be called once upon startup.
+ *  @return 0 upon success.  Negative if error.
+*/
+int uart_init(void){
+    const char * mode = getenv("DECODER_UART");
+    const char * baud = getenv("DECODER_BAUD");
+
+    if (baud != NULL && atol(baud) > 0) {
+        // 10 bits per byte with the start and stop bits
+        byte_ns = 10ULL * 1000000000 / atol(baud);
+    }
+
+    if (mode != NULL && strcmp(mode, "stdio") == 0) {
+        uart_in = STDIN_FILENO;
+        uart_out = STDOUT_FILENO;
+        return E_NO_ERROR;
+    }
+
+    uart_in = uart_out = open_pty();
+    if (uart_in < 0) {
+        perror("decoder: could not open pty");
+        return -1;
+    }
+
+    return E_NO_ERROR;
+}
+
+/** @brief Reads a byte from UART and reports an error if the read fails.
+ * 
+ *  @return The character read.
+*/
+int uart_readbyte_raw(void){
+    return uart_readbyte();
+}
+
+/** @brief Reads the next available character from UART.
+ * 
+ *  @note Exits the simulator once the input is closed.
+ *  @return The character read.
+*/
+int uart_readbyte(void){
+    bool waited = false;
+
+    if (rx_pos == rx_len) {
+        // Anything we owe the host has to go out before we block on it
+        uart_drain();
+
+        struct pollfd pfd = { .fd = uart_in, .events = POLLIN };
+        waited = poll(&pfd, 1, 0) == 0;
+
+        ssize_t ret;
+        do {
+            ret = read(uart_in, rx_buf, sizeof(rx_buf));
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret <= 0) {
+            exit(0);
+        }
+        rx_len = ret;
+        rx_pos = 0;
+    }
+
+    pace_rx(waited);
+    return rx_buf[rx_pos++];
+}
+
+/** @brief Checks whether a received character is waiting to be read.
+ * 
+ *  @note Sends anything buffered first, as the firmware only asks once it
+ *      is done with the last packet.
+ *  @return true if uart_readbyte() would return without blocking.
+*/
+bool uart_rx_ready(void){
+    uart_drain();
+    if (rx_pos < rx_len) {
+        return true;
+    }
+
+    struct pollfd pfd = { .fd = uart_in, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/** @brief Writes a byte to UART.
+ * 
+ *  @param data The byte to be written.
+*/
+void uart_writebyte(uint8_t data) {
+    if (tx_len == sizeof(tx_buf)) {
+        uart_drain();
+    }
+    tx_buf[tx_len++] = data;
+}
+
+/** @brief Flushes UART.
+*/
+void uart_flush(void){
+    rx_len = rx_pos = 0;
+    tx_len = 0;
+    if (isatty(uart_in)) {
+        tcflush(uart_in, TCIOFLUSH);
+    }
+}
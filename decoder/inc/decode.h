@@ -16,14 +16,47 @@
 
 #define MAX_FRAME_SIZE 64
 
+// Channels whose frame cadence is tracked, and keys derived ahead for each
+#define PREDICT_SLOTS 4
+#define PREDICT_AHEAD 2
+
 #pragma pack(push, 1)
 
 typedef union {
     uint8_t data[MAX_FRAME_SIZE];
 } frame_t;
 
+// A channel's frame cadence, and the keys of the frames expected next on it,
+// derived ahead of time while the UART is idle
+typedef struct {
+    bool valid;
+    channel_id_t channel;
+    timestamp_t last;
+    timestamp_t stride;
+    bool steady;
+    uint8_t n_keys;
+    timestamp_t ts[PREDICT_AHEAD];
+    aeskey_t keys[PREDICT_AHEAD];
+} predicted_keys_t;
+
+// Frames decoded with and without a key derived ahead, and keys derived ahead
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t derived;
+} predict_stats_t;
+
 #pragma pack(pop)
 
+bool decode_idle_step(void);
+void decode_idle_stop(void);
+void invalidate_predicted_keys(channel_id_t channel);
+void get_predict_stats(predict_stats_t * out);
+void reset_predict_stats(void);
+void decode_rx_hook(const packet_t * packet, uint16_t received);
 void decode(packet_t * packet, uint16_t len);
+void decode_batch(packet_t * packet, uint16_t len);
+void decode_root(packet_t * packet, uint16_t len);
+void decode_path(packet_t * packet, uint16_t len);
 
 #endif
\ No newline at end of file
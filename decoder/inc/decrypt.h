@@ -39,6 +39,48 @@ typedef union {
     uint8_t rawBytes[BODY_LEN];
 } enc_frame_t;
 
+// A frame without a nonce on the wire. Its nonce is its channel and timestamp,
+// the AAD after the header, which never repeat under one frame key: each
+// timestamp of a channel gets its own key, and the Encoder never reuses one.
+typedef union {
+    struct {
+        union {
+            struct {
+                header_t header;
+                channel_id_t channel;
+                timestamp_t timestamp;
+            };
+            uint8_t aad[sizeof(header_t) + sizeof(channel_id_t) + sizeof(timestamp_t)];
+        };
+        uint8_t tag[AUTHTAG_LEN];
+        uint8_t ciphertext[BODY_LEN - sizeof(header_t) - sizeof(channel_id_t) - sizeof(timestamp_t) - AUTHTAG_LEN];
+    };
+    uint8_t rawBytes[BODY_LEN];
+} enc_compact_frame_t;
+
+#define COMPACT_FRAME_NONCE(enc) (&(enc)->aad[sizeof(header_t)])
+
+// One frame of a batch decode packet. The packet's signature covers the whole
+// batch, so a frame's AAD is only its own fields.
+typedef union {
+    struct {
+        union {
+            struct {
+                channel_id_t channel;
+                timestamp_t timestamp;
+                uint8_t nonce[NONCE_LEN];
+                uint8_t frame_len;
+            };
+            uint8_t aad[sizeof(channel_id_t) + sizeof(timestamp_t) + NONCE_LEN + sizeof(uint8_t)];
+        };
+        uint8_t tag[AUTHTAG_LEN];
+        uint8_t ciphertext[MAX_FRAME_SIZE];
+    };
+    uint8_t rawBytes[sizeof(channel_id_t) + sizeof(timestamp_t) + NONCE_LEN + sizeof(uint8_t) + AUTHTAG_LEN + MAX_FRAME_SIZE];
+} enc_batch_frame_t;
+
+#define BATCH_FRAME_OVERHEAD (sizeof(enc_batch_frame_t) - MAX_FRAME_SIZE)
+
 typedef union {
     struct {
         union {
@@ -57,6 +99,7 @@ typedef union {
 #pragma pack(pop)
 
 frame_t * decrypt_frame(packet_t * packet, uint16_t packet_len, aeskey_t * frame_key, uint16_t * decrypted_len);
+frame_t * decrypt_batch_frame(enc_batch_frame_t * enc, aeskey_t * frame_key);
 subscription_t * decrypt_subscription(packet_t * packet, uint16_t packet_len, uint16_t * decrypted_len);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+/**
+ * @file "ed25519_fixed.h"
+ * @author MIT TechSec
+ * @brief Ed25519 verification against one public key known at build time
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _ED25519_FIXED_H
+#define _ED25519_FIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Set to 1 (ED25519_FIXED_TABLES=1 in make) to verify with this code in place
+// of wolfCrypt's wc_ed25519_verify_msg
+#ifndef ED25519_FIXED_TABLES
+#define ED25519_FIXED_TABLES 0
+#endif
+
+#define ED25519_KEY_LEN 32
+#define ED25519_SIG_LEN 64
+
+// wNAF window width of the precomputed tables, which hold the odd multiples
+// P, 3P, ..., (2^(w-1) - 1)P. Must match TABLE_WINDOW in gen_decoder_secrets.py
+#define ED25519_TABLE_WINDOW 6
+#define ED25519_TABLE_POINTS (1 << (ED25519_TABLE_WINDOW - 2))
+
+// Scalars are split into two 128 bit halves, so a half table holds 2^128 P
+#define ED25519_HALF_BITS 128
+
+// A field element mod 2^255 - 19, as little endian 32 bit words
+typedef uint32_t ed25519_fe_t[8];
+
+// An affine point in the form mixed addition wants it
+typedef struct {
+    ed25519_fe_t y_plus_x;
+    ed25519_fe_t y_minus_x;
+    ed25519_fe_t xy2d;
+} ed25519_precomp_t;
+
+// Odd multiples of the base point B and of the negated public key -A, and
+// of both times 2^128, generated into secrets.c by gen_decoder_secrets.py
+typedef struct {
+    ed25519_precomp_t base[ED25519_TABLE_POINTS];
+    ed25519_precomp_t base_hi[ED25519_TABLE_POINTS];
+    ed25519_precomp_t neg_key[ED25519_TABLE_POINTS];
+    ed25519_precomp_t neg_key_hi[ED25519_TABLE_POINTS];
+} ed25519_tables_t;
+
+int ed25519_fixed_check(const ed25519_tables_t * tables, const uint8_t * pubkey);
+int ed25519_fixed_verify(const ed25519_tables_t * tables, const uint8_t * pubkey,
+                         const uint8_t * signature, const uint8_t * msg, size_t msg_len);
+
+#endif
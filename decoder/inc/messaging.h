@@ -13,15 +13,33 @@
 #include <stdint.h>
 #include "simple_uart.h"
 
+// Large enough for a worst case subscription update, which only outgrows
+// 4 KB with the 4-ary KDF tree (see SUBSCRIPTION_MAX_NODES)
+#if defined(KDF_ARITY_BITS) && KDF_ARITY_BITS == 2
+#define BODY_LEN 4864
+#else
 #define BODY_LEN 4096
+#endif
 
 #define MAGIC_BYTE 0x25
 #define OPCODE_DECODE 0x44
+#define OPCODE_COMPACT 0x43
+#define OPCODE_BATCH 0x42
+#define OPCODE_ROOT 0x52
+#define OPCODE_PATH 0x50
 #define OPCODE_SUBSCRIBE 0x53
 #define OPCODE_LIST 0x4C
 #define OPCODE_ACK 0x41
 #define OPCODE_ERROR 0x45
 #define OPCODE_DEBUG 0x47
+#define OPCODE_WINDOW 0x57
+
+// Bytes sent between ACKs, until the host negotiates a larger window. The
+// window goes back to DEFAULT_WINDOW on any error or LIST, or once the host
+// stalls for WINDOW_TIMEOUT_US where a DEFAULT_WINDOW host would wait for an ACK
+#define DEFAULT_WINDOW 256
+#define MAX_WINDOW BODY_LEN
+#define WINDOW_TIMEOUT_US 100000
 
 #define PACKET_LEN sizeof(packet_t)
 
@@ -46,11 +64,19 @@ typedef union {
 
 #pragma pack(pop)
 
+// Called after each body byte lands, with the number of body bytes received so
+// far, so a handler can get started on a packet while the rest of it arrives.
+// Must return within about a byte time, or the UART RX FIFO overruns.
+typedef void (*rx_hook_t)(const packet_t * packet, uint16_t received);
+
 #define send_ack() send_header(OPCODE_ACK, 0)
-#define send_error() send_header(OPCODE_ERROR, 0)
 
-int read_packet(packet_t * packet);
+int read_packet(packet_t * packet, rx_hook_t hook);
+void negotiate_window(packet_t * packet, uint16_t len);
+void reset_window(void);
+void send_error(void);
 int send_packet(uint8_t * buf, uint16_t len, uint8_t opcode);
+void send_debug(uint8_t * buf, uint16_t len);
 
 bool send_header(uint8_t opcode, uint16_t len);
 bool read_ack(void);
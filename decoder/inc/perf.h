@@ -0,0 +1,80 @@
+/**
+ * @file "perf.h"
+ * @author MIT TechSec
+ * @brief Performance counter header
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <stdint.h>
+#include "messaging.h"
+#include "simple_cycles.h"
+
+// Set to 1 (PERF_COUNTERS=1 in make) to compile the timing and the debug
+// command in
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 0
+#endif
+
+// Histogram buckets, one per power of two of cycle counter ticks
+#define PERF_BUCKETS 32
+
+// Query flag to clear the counters once they are reported
+#define PERF_QUERY_RESET 0x01
+
+// Phases of handling a packet that get timed
+typedef enum {
+    PERF_HEADER,    // header, from its first byte
+    PERF_BODY,      // body, including running the rx hook
+    PERF_VERIFY,    // verify_packet()
+    PERF_LOOKUP,    // subscription and parent node lookup
+    PERF_DERIVE,    // frame key derivation
+    PERF_DECRYPT,   // frame decryption
+    PERF_SEND,      // send_packet(), including the host's ACKs
+    PERF_PHASES
+} perf_phase_t;
+
+#pragma pack(push, 1)
+
+// Durations of one phase in cycle counter ticks, with buckets[i] counting
+// those in [2^i, 2^(i+1)) (and bucket 0 also those of 0 ticks)
+typedef struct {
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+    uint32_t buckets[PERF_BUCKETS];
+} perf_histogram_t;
+
+// Body of the debug packet answering a perf query
+typedef struct {
+    uint32_t ticks_per_us;
+    uint8_t n_phases;
+    uint8_t n_buckets;
+    perf_histogram_t phases[PERF_PHASES];
+    // KDF cache and key prediction counters
+    uint32_t kdf_hits;
+    uint32_t kdf_misses;
+    uint32_t kdf_digests;
+    uint32_t predict_hits;
+    uint32_t predict_misses;
+    uint32_t predict_derived;
+} perf_report_t;
+
+#pragma pack(pop)
+
+#if PERF_COUNTERS
+#define PERF_START() cycles_now()
+#define PERF_RECORD(phase, start) perf_record((phase), cycles_now() - (start))
+#else
+#define PERF_START() 0
+#define PERF_RECORD(phase, start) ((void)(start))
+#endif
+
+void perf_record(perf_phase_t phase, uint32_t ticks);
+void perf_query(packet_t * packet, uint16_t len);
+
+#endif
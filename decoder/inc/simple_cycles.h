@@ -0,0 +1,36 @@
+/**
+ * @file "simple_cycles.h"
+ * @author MIT TechSec
+ * @brief Cycle counter header
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#ifndef __SIMPLE_CYCLES__
+#define __SIMPLE_CYCLES__
+
+#include <stdint.h>
+
+/** @brief Starts the cycle counter.
+ * 
+ *  @note This function should be called once upon startup, after the
+ *      system clock is selected.
+*/
+void cycles_init(void);
+
+/** @brief Reads the cycle counter.
+ * 
+ *  @note The counter wraps around, so only the difference between two
+ *      readings is meaningful.
+ *  @return The current count.
+*/
+uint32_t cycles_now(void);
+
+/** @brief Counter ticks per microsecond.
+ * 
+ *  @return The counter's rate.
+*/
+uint32_t cycles_per_us(void);
+
+#endif // __SIMPLE_CYCLES__
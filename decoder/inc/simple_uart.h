@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include "uart.h"
 #include "nvic_table.h"
@@ -47,6 +48,12 @@ int uart_readbyte_raw(void);
 */
 int uart_readbyte(void);
 
+/** @brief Checks whether a received character is waiting to be read.
+ * 
+ *  @return true if uart_readbyte() would return without blocking.
+*/
+bool uart_rx_ready(void);
+
 /** @brief Writes a byte to UART.
  * 
  *  @param data The byte to be written.
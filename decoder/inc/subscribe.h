@@ -15,23 +15,63 @@
 #include "messaging.h"
 #include "cryptosystem.h"
 
-#define NUM_MAX_SUBSCRIPTIONS 8
+#define NUM_MAX_SUBSCRIPTIONS 32
 
+// Keys held by the working set across all subscriptions, as many as eight
+// worst case subscriptions
+#define SUB_POOL_NODES (8 * SUBSCRIPTION_MAX_NODES)
+
+// Subscriptions are appended to a log in one of two halves of the
+// subscription pages. When the active half fills up, the live set is copied
+// into the other one, so pages are only erased once per compaction.
 #define SUB_FLASH_START 0x10042000
-#define SUB1 (SUB_FLASH_START + (0 * MXC_FLASH_PAGE_SIZE))
-#define SUB2 (SUB_FLASH_START + (1 * MXC_FLASH_PAGE_SIZE))
-#define SUB3 (SUB_FLASH_START + (2 * MXC_FLASH_PAGE_SIZE))
-#define SUB4 (SUB_FLASH_START + (3 * MXC_FLASH_PAGE_SIZE))
-#define SUB5 (SUB_FLASH_START + (4 * MXC_FLASH_PAGE_SIZE))
-#define SUB6 (SUB_FLASH_START + (5 * MXC_FLASH_PAGE_SIZE))
-#define SUB7 (SUB_FLASH_START + (6 * MXC_FLASH_PAGE_SIZE))
-#define SUB8 (SUB_FLASH_START + (7 * MXC_FLASH_PAGE_SIZE))
+#define SUB_LOG_HALF_PAGES 7
+#define SUB_LOG_HALF_SIZE (SUB_LOG_HALF_PAGES * MXC_FLASH_PAGE_SIZE)
+#define SUB_LOG_HALF(half) (SUB_FLASH_START + (half) * SUB_LOG_HALF_SIZE)
+
+// Flash is programmed in 128 bit lines, so records start on line boundaries
+#define SUB_LOG_LINE 16
+#define SUB_LOG_ALIGN(len) (((len) + SUB_LOG_LINE - 1) & ~(SUB_LOG_LINE - 1))
+
+#define SUB_LOG_HALF_MAGIC 0x5342484c
+#define SUB_LOG_RECORD_MAGIC 0x53425243
+#define SUB_LOG_COMMIT_MAGIC 0x5342434d
+
+// A record is its header line, the compact subscription padded to whole
+// lines, then a commit line written last, so torn appends are skipped
+#define SUB_LOG_RECORD_SIZE(len) \
+    (sizeof(sub_log_line_t) + SUB_LOG_ALIGN(len) + sizeof(sub_log_line_t))
+
+// Buckets in the channel -> working set lookup table (power of two, > NUM_MAX_SUBSCRIPTIONS)
+#define SUB_TABLE_BUCKETS 64
 
 #pragma pack(push, 1)
 
+// Header of a log half, and the header and commit lines of each record
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t length;
+    uint8_t reserved[6];
+} sub_log_line_t;
+
+// SRAM copy of the live subscription for one channel, so decode() never
+// reads flash. Its nodes and index entries sit at first in the shared pools.
+typedef struct {
+    channel_id_t channel;
+    timestamp_t start;
+    timestamp_t end;
+    uint8_t n_nodes;
+    uint16_t first;
+    uint32_t seq;
+} active_subscription_t;
+
 #pragma pack(pop)
 
-subscription_t * find_subscription(uint32_t channel, bool empty_ok);
+void clear_subscription_log(void);
+void load_subscriptions(void);
+const active_subscription_t * find_active_subscription(uint32_t channel);
+const kdf_node_t * find_active_parent(const active_subscription_t * active, timestamp_t ts);
 void subscribe(packet_t * packet, uint16_t len);
 
 #endif
\ No newline at end of file
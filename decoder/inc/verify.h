@@ -11,11 +11,26 @@
 #define _VERIFY_H
 
 #include "messaging.h"
-#include "wolfssl/wolfcrypt/ed25519.h"
+#include "ed25519_fixed.h"
 
-#define SIGNATURE_LEN 64
+#define SIGNATURE_LEN ED25519_SIG_LEN
+
+// Frames signed as a group carry a path to the group's Merkle root instead of
+// a signature. Nodes are SHA-256 truncated to MERKLE_HASH_LEN bytes, with a
+// prefix byte telling leaves and interior nodes apart
+#define MERKLE_HASH_LEN 16
+#define MERKLE_MAX_DEPTH 8
+#define MERKLE_LEAF_PREFIX 0x00
+#define MERKLE_NODE_PREFIX 0x01
+
+// Signed roots remembered at once, so a group's frames can still arrive after
+// the roots of the next few groups
+#define ROOT_CACHE_SLOTS 4
 
 int init_signing_key(void);
 int verify_packet(packet_t * packet, uint16_t len);
+int verify_root_packet(packet_t * packet, uint16_t len);
+int verify_merkle_path(const uint8_t * leaf, uint16_t leaf_len, uint8_t index,
+                       const uint8_t * path, uint8_t depth);
 
 #endif
\ No newline at end of file
@@ -25,6 +25,24 @@ ENTRY=firmware_startup
 # ********** Integration with native KDF code **********
 PROJ_CFLAGS += -I./cryptosystem/src
 SRCS += ./cryptosystem/src/cryptosystem.c
+# KDF tree shape, 1 for the binary SHA-256 tree or 2 for the 4-ary SHA-512 tree
+# (must match the kdf_arity_bits gen_secrets recorded from ECTF25_KDF_ARITY_BITS,
+# which secrets.c checks)
+KDF_ARITY_BITS ?= 1
+PROJ_CFLAGS += -DKDF_ARITY_BITS=$(KDF_ARITY_BITS)
+
+# ****************** Ed25519 verifier ******************
+# Verify signatures with build-time tables for the encoder's key (src/ed25519_fixed.c)
+# instead of wolfCrypt. Off until it is shown to be faster on the board
+ED25519_FIXED_TABLES ?= 0
+PROJ_CFLAGS += -DED25519_FIXED_TABLES=$(ED25519_FIXED_TABLES)
+
+# ****************** Perf counters *********************
+# Phase timing with the DWT cycle counter, reported by the debug (G) command.
+# Off by default, as the debug command is unauthenticated: build with
+# `make PERF_COUNTERS=1` to profile
+PERF_COUNTERS ?= 0
+PROJ_CFLAGS += -DPERF_COUNTERS=$(PERF_COUNTERS)
 
 # ********************** wolfSSL ***********************
 VPATH += $(WOLFSSL_PATH)/wolfcrypt/src
@@ -12,6 +12,7 @@
 #include "decrypt.h"
 #include "subscribe.h"
 #include "cryptosystem.h"
+#include "perf.h"
 
 extern const kdf_node_t SUB0_NODE;
 
@@ -21,7 +22,283 @@ extern const kdf_node_t SUB0_NODE;
 static bool decoded_anything = false;
 static timestamp_t last_timestamp = 0;
 
+// Frame key derivation started by decode_rx_hook() while the packet came in
+static kdf_walk_t pending_walk = {0};
+static bool walk_pending = false;
+static channel_id_t pending_channel = 0;
+
+// Body bytes up to and including the timestamp, i.e. where derivation can begin
+#define FRAME_KEY_FIELDS_LEN (sizeof(channel_id_t) + sizeof(timestamp_t))
+
+// Keys derived ahead for the channels decoded most recently, and the
+// derivation decode_idle_step() has under way
+static predicted_keys_t predicted[PREDICT_SLOTS] = {0};
+static uint8_t predicted_victim = 0;
+static predict_stats_t predict_stats = {0};
+static kdf_walk_t idle_walk = {0};
+static bool idle_walking = false;
+static uint8_t idle_slot = 0;
+
+/** @brief Find the node a frame's key derives from, if it is one we would decode.
+ * 
+ *  @param channel: channel_id_t, Channel of the frame.
+ *  @param timestamp: timestamp_t, Timestamp of the frame.
+ * 
+ *  @return const kdf_node_t *: subscription node covering the frame, NULL if none.
+ */
+static const kdf_node_t * find_frame_parent(channel_id_t channel, timestamp_t timestamp) {
+    // Check timestamp
+    if (decoded_anything && timestamp <= last_timestamp)
+        return NULL;
+
+    if (channel == 0)
+        return &SUB0_NODE;
+
+    // Check if we are subscribed
+    const active_subscription_t * subscription = find_active_subscription(channel);
+    if (subscription == NULL)
+        return NULL;
+
+    return find_active_parent(subscription, timestamp);
+}
+
+/** @brief Find the predictions for a channel.
+ * 
+ *  @param channel: channel_id_t, Channel to look for.
+ * 
+ *  @return predicted_keys_t *: the channel's predictions, NULL if it isn't tracked.
+ */
+static predicted_keys_t * find_predicted(channel_id_t channel) {
+    for (int i = 0; i < PREDICT_SLOTS; i++) {
+        if (predicted[i].valid && predicted[i].channel == channel)
+            return &predicted[i];
+    }
+    return NULL;
+}
+
+/** @brief Find a key derived ahead for a frame.
+ * 
+ *  @param channel: channel_id_t, Channel of the frame.
+ *  @param timestamp: timestamp_t, Timestamp of the frame.
+ * 
+ *  @return const aeskey_t *: the frame key, NULL if it wasn't predicted.
+ */
+static const aeskey_t * find_predicted_key(channel_id_t channel, timestamp_t timestamp) {
+    const predicted_keys_t * slot = find_predicted(channel);
+    if (slot == NULL)
+        return NULL;
+
+    for (int k = 0; k < slot->n_keys; k++) {
+        if (slot->ts[k] == timestamp)
+            return &slot->keys[k];
+    }
+    return NULL;
+}
+
+/** @brief Get the key for a frame, from the predictions if it was derived ahead.
+ * 
+ *  @param channel: channel_id_t, Channel of the frame.
+ *  @param kdf_node: const kdf_node_t *, Subscription node covering the frame.
+ *  @param timestamp: timestamp_t, Timestamp of the frame.
+ *  @param frame_key: aeskey_t *, Output frame key.
+ * 
+ *  @return int: 0 on success, -1 on failure.
+ */
+static int get_frame_key(channel_id_t channel, const kdf_node_t * kdf_node, timestamp_t timestamp,
+                         aeskey_t * frame_key) {
+    uint32_t start = PERF_START();
+    int ret = 0;
+
+    const aeskey_t * key = find_predicted_key(channel, timestamp);
+    if (key != NULL) {
+        predict_stats.hits++;
+        memcpy(frame_key, key, sizeof(aeskey_t));
+    } else {
+        predict_stats.misses++;
+        ret = derive_node_subkey_cached(channel, kdf_node, timestamp, frame_key);
+    }
+
+    PERF_RECORD(PERF_DERIVE, start);
+    return ret;
+}
+
+/** @brief Track a decoded frame's timestamp, so the keys after it can be derived ahead.
+ * 
+ *  The stride is the gap to the channel's previous frame. Keys derived ahead
+ *  on the same stride and still in the future are kept. Keys are only derived
+ *  ahead once the same stride comes up twice in a row, as timestamps that
+ *  jitter would waste the digests.
+ * 
+ *  @param channel: channel_id_t, Channel of the frame.
+ *  @param timestamp: timestamp_t, Timestamp of the frame.
+ */
+static void observe_frame(channel_id_t channel, timestamp_t timestamp) {
+    predicted_keys_t * slot = find_predicted(channel);
+    if (slot == NULL) {
+        slot = &predicted[predicted_victim];
+        predicted_victim = (predicted_victim + 1) % PREDICT_SLOTS;
+        memset(slot, 0, sizeof(*slot));
+        slot->valid = true;
+        slot->channel = channel;
+        slot->last = timestamp;
+        return;
+    }
+
+    timestamp_t stride = timestamp > slot->last ? timestamp - slot->last : 0;
+    uint8_t kept = 0;
+    for (int k = 0; k < slot->n_keys; k++) {
+        if (stride != slot->stride || slot->ts[k] <= timestamp)
+            continue;
+        slot->ts[kept] = slot->ts[k];
+        memcpy(&slot->keys[kept], &slot->keys[k], sizeof(aeskey_t));
+        kept++;
+    }
+    memset(&slot->keys[kept], 0, (PREDICT_AHEAD - kept) * sizeof(aeskey_t));
+
+    slot->n_keys = kept;
+    slot->steady = stride == slot->stride;
+    slot->stride = stride;
+    slot->last = timestamp;
+}
+
+/** @brief Get the timestamp a channel's next key should be derived ahead for.
+ * 
+ *  @param slot: const predicted_keys_t *, The channel's predictions.
+ *  @param timestamp: timestamp_t *, Output timestamp.
+ * 
+ *  @return bool: true if there is one, false if the keys are all derived or
+ *      the cadence isn't steady.
+ */
+static bool next_prediction(const predicted_keys_t * slot, timestamp_t * timestamp) {
+    if (!slot->valid || !slot->steady || slot->stride == 0 || slot->n_keys == PREDICT_AHEAD)
+        return false;
+
+    timestamp_t from = slot->n_keys ? slot->ts[slot->n_keys - 1] : slot->last;
+    if (from > UINT64_MAX - slot->stride)
+        return false;
+
+    *timestamp = from + slot->stride;
+    return true;
+}
+
+/** @brief Derive one tree level of a predicted frame key while waiting for a packet.
+ * 
+ *  Call repeatedly until a byte arrives, then call decode_idle_stop(). Each
+ *  call costs one digest, so the UART's receive FIFO never overflows in the
+ *  meantime. Predictions past the end of a subscription are skipped.
+ * 
+ *  @return bool: true if there is more to derive, false once every tracked
+ *      channel has its keys.
+ */
+bool decode_idle_step(void) {
+    timestamp_t timestamp = 0;
+
+    if (!idle_walking) {
+        // Take the channels in turn, so each one gets its next key soon
+        int i;
+        const kdf_node_t * kdf_node = NULL;
+        for (i = 0; i < PREDICT_SLOTS; i++) {
+            idle_slot = (idle_slot + 1) % PREDICT_SLOTS;
+            if (next_prediction(&predicted[idle_slot], &timestamp)) {
+                kdf_node = find_frame_parent(predicted[idle_slot].channel, timestamp);
+                if (kdf_node != NULL)
+                    break;
+            }
+        }
+        if (kdf_node == NULL ||
+            kdf_walk_begin(&idle_walk, predicted[idle_slot].channel, kdf_node, timestamp) != 0)
+            return false;
+        idle_walking = true;
+    }
+
+    int ret = kdf_walk_step(&idle_walk);
+    if (ret == 0)
+        return true;
+
+    idle_walking = false;
+    predicted_keys_t * slot = &predicted[idle_slot];
+    if (ret < 0 || kdf_walk_finish(&idle_walk, &slot->keys[slot->n_keys]) != 0)
+        return false;
+
+    slot->ts[slot->n_keys++] = idle_walk.ts;
+    predict_stats.derived++;
+    return true;
+}
+
+/** @brief Put aside the derivation decode_idle_step() was in the middle of.
+ * 
+ *  The levels derived so far stay in the channel's KDF cache, so the next
+ *  derivation on the channel, idle or not, starts from there.
+ */
+void decode_idle_stop(void) {
+    if (idle_walking)
+        kdf_walk_suspend(&idle_walk);
+    idle_walking = false;
+}
+
+/** @brief Drop the keys derived ahead for a channel, whose subscription changed.
+ * 
+ *  @param channel: channel_id_t, Channel to drop.
+ */
+void invalidate_predicted_keys(channel_id_t channel) {
+    predicted_keys_t * slot = find_predicted(channel);
+    if (slot != NULL)
+        memset(slot, 0, sizeof(*slot));
+}
+
+/** @brief Get the prediction counters.
+ * 
+ *  @param out: predict_stats_t *, Output counters.
+ */
+void get_predict_stats(predict_stats_t * out) {
+    *out = predict_stats;
+}
+
+/** @brief Clear the prediction counters.
+ */
+void reset_predict_stats(void) {
+    memset(&predict_stats, 0, sizeof(predict_stats));
+}
+
+/** @brief Start deriving the frame key while the rest of a decode packet arrives.
+ * 
+ *  Once the channel and timestamp have landed, each further byte advances the
+ *  derivation by one tree level, which fits comfortably in a byte time. The
+ *  packet is still unverified at this point, so the walk derives into its own
+ *  copy of the path: decode() only finishes it, and with that stores it in the
+ *  channel's KDF cache, after the signature checks out. A forged header costs
+ *  a dropped walk, never the channel's cached path.
+ * 
+ *  @param packet: const packet_t *, Pointer to the packet being read.
+ *  @param received: uint16_t, Number of body bytes received so far.
+ */
+void decode_rx_hook(const packet_t * packet, uint16_t received) {
+    const enc_frame_t * enc_frame = (const enc_frame_t *)packet;
+
+    if (received < FRAME_KEY_FIELDS_LEN) {
+        walk_pending = false;
+        return;
+    }
+
+    if (received == FRAME_KEY_FIELDS_LEN) {
+        // Nothing to do for a frame whose key was derived ahead
+        const kdf_node_t * kdf_node = find_frame_parent(enc_frame->channel, enc_frame->timestamp);
+        walk_pending = kdf_node != NULL &&
+            find_predicted_key(enc_frame->channel, enc_frame->timestamp) == NULL &&
+            kdf_walk_begin(&pending_walk, enc_frame->channel, kdf_node, enc_frame->timestamp) == 0;
+        pending_channel = enc_frame->channel;
+        return;
+    }
+
+    if (walk_pending && kdf_walk_step(&pending_walk) < 0) {
+        walk_pending = false;
+    }
+}
+
 /** @brief Handle decode command, returning a successfully decoded frame over UART
+ * 
+ *  Compact decode packets are handled here too: their channel and timestamp
+ *  sit where a decode packet's do, and the response carries their opcode.
  * 
  *  @param packet: packet_t *, Pointer to the packet to be read from.
  *  @param len: uint16_t, Length of the packet in bytes.
@@ -29,50 +306,220 @@ static timestamp_t last_timestamp = 0;
 void decode(packet_t * packet, uint16_t len) {
     // Validate the packet
     if (verify_packet(packet, len) != 0) {
+        walk_pending = false;
         send_error();
         return;
     }
 
     enc_frame_t * enc_frame = (enc_frame_t *)packet;
+    uint8_t opcode = packet->header.opcode;
 
-    // Check if we are subscribed
-    subscription_t * subscription = find_subscription(enc_frame->channel, false);
-
-    if (subscription != NULL || enc_frame->channel == 0) {
-        // Check timestamp
-        if ((decoded_anything == false) || (enc_frame->timestamp > last_timestamp)) {
-            // Find the correct decryption key
-            kdf_node_t * kdf_node = &SUB0_NODE;
-            if (enc_frame->channel != 0) {
-                kdf_node = find_ts_parent(subscription, enc_frame->timestamp);
-                if (kdf_node == NULL) {
-                    send_error();
-                    return;
-                }
-            }
+    // Find the correct decryption key
+    uint32_t start = PERF_START();
+    const kdf_node_t * kdf_node = find_frame_parent(enc_frame->channel, enc_frame->timestamp);
+    PERF_RECORD(PERF_LOOKUP, start);
+    if (kdf_node == NULL) {
+        walk_pending = false;
+        send_error();
+        return;
+    }
 
-            aeskey_t frame_key = { 0 };
-            int ret = derive_node_subkey(kdf_node, enc_frame->timestamp, &frame_key);
-            if (ret != 0) {
-                send_error();
-                return;
-            }
+    // Pick up the derivation decode_rx_hook() started, if it is for this frame
+    aeskey_t frame_key = { 0 };
+    int ret;
+    if (walk_pending && pending_channel == enc_frame->channel && pending_walk.ts == enc_frame->timestamp) {
+        start = PERF_START();
+        predict_stats.misses++;
+        ret = kdf_walk_finish(&pending_walk, &frame_key);
+        PERF_RECORD(PERF_DERIVE, start);
+    } else {
+        ret = get_frame_key(enc_frame->channel, kdf_node, enc_frame->timestamp, &frame_key);
+    }
+    walk_pending = false;
+    if (ret != 0) {
+        send_error();
+        return;
+    }
+
+    // Decrypt
+    uint16_t frame_len = 0;
+    start = PERF_START();
+    frame_t * frame = decrypt_frame(packet, len, &frame_key, &frame_len);
+    PERF_RECORD(PERF_DECRYPT, start);
+
+    // Send the frame
+    if (frame != NULL && frame_len > 0 && frame_len <= MAX_FRAME_SIZE) {
+        // For a successful decryption, update last_timestamp.
+        decoded_anything = true;
+        last_timestamp = enc_frame->timestamp;
+        observe_frame(enc_frame->channel, enc_frame->timestamp);
+
+        send_packet(frame->data, frame_len, opcode);
+        return;
+    }
+
+    send_error();
+}
+
+/** @brief Handle batch decode command, returning every frame of the batch over UART
+ * 
+ *  The body is a frame count followed by that many enc_batch_frame_t, each cut
+ *  short after frame_len bytes of ciphertext, then one signature over the
+ *  whole packet. The response is the frame count followed by, for each frame
+ *  in order, a length byte and the decoded frame. Frames that can't be decoded
+ *  (not subscribed, stale timestamp, bad tag) get length 0 and no data.
+ * 
+ *  The response is compacted in place over the packet: a frame's output never
+ *  extends past the start of its own ciphertext, so nothing unread is clobbered.
+ * 
+ *  @param packet: packet_t *, Pointer to the packet to be read from.
+ *  @param len: uint16_t, Length of the packet in bytes.
+ */
+void decode_batch(packet_t * packet, uint16_t len) {
+    // Validate the packet
+    if (len < sizeof(header_t) + sizeof(uint8_t) + SIGNATURE_LEN || verify_packet(packet, len) != 0) {
+        send_error();
+        return;
+    }
 
-            // Decrypt
-            uint16_t frame_len = 0;
-            frame_t * frame = decrypt_frame(packet, len, &frame_key, &frame_len);
+    uint16_t body_len = len - sizeof(header_t) - SIGNATURE_LEN;
+    uint8_t n_frames = packet->body[0];
+
+    // Check that the frames exactly fill the body before decoding any of them
+    uint16_t in = sizeof(uint8_t);
+    for (int i = 0; i < n_frames; i++) {
+        const enc_batch_frame_t * enc = (const enc_batch_frame_t *)&packet->body[in];
+        if (in + BATCH_FRAME_OVERHEAD > body_len || enc->frame_len > MAX_FRAME_SIZE) {
+            send_error();
+            return;
+        }
+        in += BATCH_FRAME_OVERHEAD + enc->frame_len;
+    }
+    if (in != body_len) {
+        send_error();
+        return;
+    }
 
-            // Send the frame
-            if (frame != NULL && frame_len > 0 && frame_len <= MAX_FRAME_SIZE) {
-                // For a successful decryption, update last_timestamp.
-                decoded_anything = true;
-                last_timestamp = enc_frame->timestamp;
+    uint16_t out = sizeof(uint8_t);
+    in = sizeof(uint8_t);
+    for (int i = 0; i < n_frames; i++) {
+        enc_batch_frame_t * enc = (enc_batch_frame_t *)&packet->body[in];
+        channel_id_t channel = enc->channel;
+        timestamp_t timestamp = enc->timestamp;
+        uint8_t frame_len = enc->frame_len;
+        frame_t * frame = NULL;
+        in += BATCH_FRAME_OVERHEAD + frame_len;
 
-                send_packet(frame->data, frame_len, OPCODE_DECODE);
-                return;
+        // Same rules as decode(), including timestamps increasing frame to frame
+        uint32_t start = PERF_START();
+        const kdf_node_t * kdf_node = find_frame_parent(channel, timestamp);
+        PERF_RECORD(PERF_LOOKUP, start);
+        if (kdf_node != NULL) {
+            aeskey_t frame_key = { 0 };
+            if (get_frame_key(channel, kdf_node, timestamp, &frame_key) == 0) {
+                start = PERF_START();
+                frame = decrypt_batch_frame(enc, &frame_key);
+                PERF_RECORD(PERF_DECRYPT, start);
             }
         }
+
+        if (frame == NULL) {
+            packet->body[out++] = 0;
+            continue;
+        }
+
+        decoded_anything = true;
+        last_timestamp = timestamp;
+        observe_frame(channel, timestamp);
+
+        packet->body[out++] = frame_len;
+        memmove(&packet->body[out], frame->data, frame_len);
+        out += frame_len;
     }
 
-    send_error();
-}
\ No newline at end of file
+    // Wipe plaintext left behind where frames were decrypted
+    memset(&packet->body[out], 0, body_len - out);
+
+    send_packet(packet->body, out, OPCODE_BATCH);
+}
+
+
+/** @brief Handle signed root command, so the frames of a group can be decoded
+ *      with decode_path() without a signature each.
+ * 
+ *  The body is the group's Merkle root and a signature over the packet. The
+ *  response is an empty root packet once the root is cached.
+ * 
+ *  @param packet: packet_t *, Pointer to the packet to be read from.
+ *  @param len: uint16_t, Length of the packet in bytes.
+ */
+void decode_root(packet_t * packet, uint16_t len) {
+    if (verify_root_packet(packet, len) != 0) {
+        send_error();
+        return;
+    }
+
+    send_header(OPCODE_ROOT, 0);
+}
+
+/** @brief Handle path decode command, returning a frame signed as part of a group
+ * 
+ *  The body is the frame's index in its group, the depth of the group's tree,
+ *  that many sibling hashes from the leaf up, then the frame as an
+ *  enc_batch_frame_t cut short after frame_len bytes of ciphertext. The frame
+ *  is authenticated by hashing up to a root verified by decode_root(), then
+ *  decoded under the same rules as decode().
+ * 
+ *  @param packet: packet_t *, Pointer to the packet to be read from.
+ *  @param len: uint16_t, Length of the packet in bytes.
+ */
+void decode_path(packet_t * packet, uint16_t len) {
+    // Index and depth
+    uint16_t in = sizeof(header_t) + 2 * sizeof(uint8_t);
+    if (len < in || len > sizeof(packet_t)) {
+        send_error();
+        return;
+    }
+
+    uint8_t index = packet->body[0];
+    uint8_t depth = packet->body[1];
+    const uint8_t * path = &packet->body[2];
+    in += depth * MERKLE_HASH_LEN;
+
+    // The frame has to exactly fill the rest of the packet
+    enc_batch_frame_t * enc = (enc_batch_frame_t *)&packet->rawBytes[in];
+    if (depth > MERKLE_MAX_DEPTH || in + BATCH_FRAME_OVERHEAD > len ||
+        enc->frame_len > MAX_FRAME_SIZE || in + BATCH_FRAME_OVERHEAD + enc->frame_len != len) {
+        send_error();
+        return;
+    }
+
+    if (verify_merkle_path(enc->rawBytes, len - in, index, path, depth) != 0) {
+        send_error();
+        return;
+    }
+
+    // Same rules as decode()
+    uint32_t start = PERF_START();
+    const kdf_node_t * kdf_node = find_frame_parent(enc->channel, enc->timestamp);
+    PERF_RECORD(PERF_LOOKUP, start);
+    aeskey_t frame_key = { 0 };
+    if (kdf_node == NULL || get_frame_key(enc->channel, kdf_node, enc->timestamp, &frame_key) != 0) {
+        send_error();
+        return;
+    }
+
+    start = PERF_START();
+    frame_t * frame = decrypt_batch_frame(enc, &frame_key);
+    PERF_RECORD(PERF_DECRYPT, start);
+    if (frame == NULL) {
+        send_error();
+        return;
+    }
+
+    decoded_anything = true;
+    last_timestamp = enc->timestamp;
+    observe_frame(enc->channel, enc->timestamp);
+
+    send_packet(frame->data, enc->frame_len, OPCODE_PATH);
+}
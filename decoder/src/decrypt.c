@@ -10,9 +10,13 @@
 #include "decrypt.h"
 
 extern const aeskey_t SUBSCRIPTION_KEY;
-static uint8_t decrypt_buffer[BODY_LEN] = { 0 };
 
-/** @brief Decrypt a frame.
+_Static_assert(sizeof(channel_id_t) + sizeof(timestamp_t) == NONCE_LEN, "compact frames use their channel and timestamp as the nonce");
+
+/** @brief Decrypt a frame in place, over its ciphertext in the packet.
+ * 
+ *  Handles both decode (enc_frame_t) and compact decode (enc_compact_frame_t)
+ *  packets, telling them apart by the opcode in the header.
  * 
  *  @param packet: packet_t *, Pointer to the encrypted packet.
  *  @param packet_len: uint16_t, Length of the encrypted packet in bytes.
@@ -24,15 +28,29 @@ static uint8_t decrypt_buffer[BODY_LEN] = { 0 };
 frame_t * decrypt_frame(packet_t * packet, uint16_t packet_len, aeskey_t * frame_key, uint16_t * decrypted_len) {
     int ret;
     Aes ctx = { 0 };
-    enc_frame_t * enc = (enc_frame_t *)packet;
+    uint8_t * ciphertext, * nonce, * tag, * aad;
+    uint16_t aad_len;
 
     // Ensure packet is not larger than expected.
     if (packet_len > sizeof(packet_t)) {
         return NULL;
     }
 
-    // Clear decryption buffer
-    memset(decrypt_buffer, 0, sizeof(decrypt_buffer));
+    if (packet->header.opcode == OPCODE_COMPACT) {
+        enc_compact_frame_t * enc = (enc_compact_frame_t *)packet;
+        ciphertext = enc->ciphertext;
+        nonce = COMPACT_FRAME_NONCE(enc);
+        tag = enc->tag;
+        aad = enc->aad;
+        aad_len = sizeof(enc->aad);
+    } else {
+        enc_frame_t * enc = (enc_frame_t *)packet;
+        ciphertext = enc->ciphertext;
+        nonce = enc->nonce;
+        tag = enc->tag;
+        aad = enc->aad;
+        aad_len = sizeof(enc->aad);
+    }
 
     // Initialize AES context
     ret = wc_AesGcmSetKey(&ctx, frame_key->bytes, KEY_LEN);
@@ -41,22 +59,57 @@ frame_t * decrypt_frame(packet_t * packet, uint16_t packet_len, aeskey_t * frame
     }
 
     // Check for underflow
-    uint16_t ct_len = packet_len - SIGNATURE_LEN - AUTHTAG_LEN - NONCE_LEN - sizeof(timestamp_t) - sizeof(channel_id_t) - sizeof(header_t);
+    uint16_t ct_len = packet_len - SIGNATURE_LEN - AUTHTAG_LEN - aad_len;
     if (ct_len >= packet_len) {
         return NULL;
     }
 
     // Cross your fingers
-    ret = wc_AesGcmDecrypt(&ctx, decrypt_buffer, enc->ciphertext, ct_len, enc->nonce, sizeof(enc->nonce), enc->tag, sizeof(enc->tag), enc->aad, sizeof(enc->aad));
+    ret = wc_AesGcmDecrypt(&ctx, ciphertext, ciphertext, ct_len, nonce, NONCE_LEN, tag, AUTHTAG_LEN, aad, aad_len);
     if (ret != 0) {
+        // Don't leave unauthenticated plaintext behind
+        memset(ciphertext, 0, ct_len);
         return NULL;
     }
 
     *decrypted_len = ct_len;
-    return (frame_t *)decrypt_buffer;
+    return (frame_t *)ciphertext;
 }
 
-/** @brief Decrypt a subscription update file.
+/** @brief Decrypt one frame of a batch in place, over its ciphertext in the packet.
+ * 
+ *  @param enc: enc_batch_frame_t *, Pointer to the frame within the batch.
+ *  @param frame_key: aeskey_t *, Pointer to the appropriate frame key.
+ * 
+ *  @note The caller has already checked frame_len against the packet length.
+ * 
+ *  @return frame_t *: Pointer to the decrypted frame, NULL if decryption failed.
+ */
+frame_t * decrypt_batch_frame(enc_batch_frame_t * enc, aeskey_t * frame_key) {
+    int ret;
+    Aes ctx = { 0 };
+
+    if (enc->frame_len == 0 || enc->frame_len > MAX_FRAME_SIZE) {
+        return NULL;
+    }
+
+    // Initialize AES context
+    ret = wc_AesGcmSetKey(&ctx, frame_key->bytes, KEY_LEN);
+    if (ret != 0) {
+        return NULL;
+    }
+
+    ret = wc_AesGcmDecrypt(&ctx, enc->ciphertext, enc->ciphertext, enc->frame_len, enc->nonce, sizeof(enc->nonce), enc->tag, sizeof(enc->tag), enc->aad, sizeof(enc->aad));
+    if (ret != 0) {
+        // Don't leave unauthenticated plaintext behind
+        memset(enc->ciphertext, 0, enc->frame_len);
+        return NULL;
+    }
+
+    return (frame_t *)enc->ciphertext;
+}
+
+/** @brief Decrypt a subscription update file in place, over its ciphertext in the packet.
  * 
  *  @param packet: packet_t *, Pointer to the encrypted packet.
  *  @param packet_len: uint16_t, Length of the encrypted packet in bytes.
@@ -74,9 +127,6 @@ subscription_t * decrypt_subscription(packet_t * packet, uint16_t packet_len, ui
         return NULL;
     }
 
-    // Clear decryption buffer
-    memset(decrypt_buffer, 0, sizeof(decrypt_buffer));
-
     // Initialize AES context
     ret = wc_AesGcmSetKey(&ctx, SUBSCRIPTION_KEY.bytes, sizeof(SUBSCRIPTION_KEY.bytes));
     if (ret != 0) {
@@ -90,11 +140,13 @@ subscription_t * decrypt_subscription(packet_t * packet, uint16_t packet_len, ui
     }
 
     // Cross your fingers
-    ret = wc_AesGcmDecrypt(&ctx, decrypt_buffer, enc->ciphertext, ct_len, enc->nonce, sizeof(enc->nonce), enc->tag, sizeof(enc->tag), enc->aad, sizeof(enc->aad));
+    ret = wc_AesGcmDecrypt(&ctx, enc->ciphertext, enc->ciphertext, ct_len, enc->nonce, sizeof(enc->nonce), enc->tag, sizeof(enc->tag), enc->aad, sizeof(enc->aad));
     if (ret != 0) {
+        // Don't leave unauthenticated plaintext behind
+        memset(enc->ciphertext, 0, ct_len);
         return NULL;
     }
 
     *decrypted_len = ct_len;
-    return (subscription_t *)decrypt_buffer;
+    return (subscription_t *)enc->ciphertext;
 }
\ No newline at end of file
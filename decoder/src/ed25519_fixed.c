@@ -0,0 +1,450 @@
+/**
+ * @file "ed25519_fixed.c"
+ * @author MIT TechSec
+ * @brief Ed25519 verification against one public key known at build time
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#include <string.h>
+#include "ed25519_fixed.h"
+#include "wolfssl/wolfcrypt/sha512.h"
+
+#if ED25519_FIXED_TABLES
+
+/*
+ * Signatures are checked as R == sB - hA. Because both B and A are fixed,
+ * their tables are computed at build time instead of per verification, which
+ * also skips decompressing A. Each 253 bit scalar is split into two halves,
+ * so sB - hA becomes a four point multi-scalar multiplication over 128 bits,
+ * halving the number of doublings.
+ *
+ * Everything here works on public data (the key, message and signature), so
+ * nothing needs to be constant time.
+ */
+
+typedef uint32_t fe[8];
+
+// Extended twisted Edwards coordinates: x = X/Z, y = Y/Z, xy = T/Z
+typedef struct {
+    fe X;
+    fe Y;
+    fe Z;
+    fe T;
+} ge_p3;
+
+// Scalar digits below 2^HALF_BITS, plus room for the carry out of the top window
+#define NAF_LEN (ED25519_HALF_BITS + ED25519_TABLE_WINDOW)
+
+// Group order L = 2^252 + 27742317777372353535851937790883648493
+static const uint32_t order[8] = {
+    0x5cf5d3ed, 0x5812631a, 0xa2f79cd6, 0x14def9de, 0, 0, 0, 0x10000000,
+};
+
+// 1/2 mod p
+static const fe fe_half = {
+    0xfffffff7, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x3fffffff,
+};
+
+/******************** Field arithmetic mod p = 2^255 - 19 ********************/
+// Elements are kept below 2^256 but not fully reduced, 2^256 = 38 mod p
+
+// r += 38 * carry, for carry out of the top word
+static void fe_carry(fe r, uint64_t carry) {
+    while (carry) {
+        uint64_t c = carry * 38;
+        for (int i = 0; i < 8; i++) {
+            c += r[i];
+            r[i] = (uint32_t)c;
+            c >>= 32;
+        }
+        carry = c;
+    }
+}
+
+static void fe_add(fe r, const fe a, const fe b) {
+    uint64_t c = 0;
+    for (int i = 0; i < 8; i++) {
+        c += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    fe_carry(r, c);
+}
+
+static void fe_sub(fe r, const fe a, const fe b) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t d = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)d;
+        borrow = (d >> 32) & 1;
+    }
+    // The result wrapped around 2^256, which is 38 too much mod p
+    while (borrow) {
+        uint64_t d = (uint64_t)r[0] - 38;
+        r[0] = (uint32_t)d;
+        borrow = (d >> 32) & 1;
+        for (int i = 1; i < 8 && borrow; i++) {
+            d = (uint64_t)r[i] - 1;
+            r[i] = (uint32_t)d;
+            borrow = (d >> 32) & 1;
+        }
+    }
+}
+
+static void fe_mul(fe r, const fe a, const fe b) {
+    uint32_t t[16] = { 0 };
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t c = 0;
+        for (int j = 0; j < 8; j++) {
+            c += (uint64_t)a[i] * b[j] + t[i + j];
+            t[i + j] = (uint32_t)c;
+            c >>= 32;
+        }
+        t[i + 8] = (uint32_t)c;
+    }
+
+    // Fold the top half back in
+    uint64_t c = 0;
+    for (int i = 0; i < 8; i++) {
+        c += t[i] + (uint64_t)38 * t[i + 8];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    fe_carry(r, c);
+}
+
+static void fe_sq(fe r, const fe a) {
+    fe_mul(r, a, a);
+}
+
+// r = a^(2^n)
+static void fe_sqn(fe r, const fe a, int n) {
+    fe_sq(r, a);
+    for (int i = 1; i < n; i++) {
+        fe_sq(r, r);
+    }
+}
+
+// r = a^(p - 2) = 1/a, with the usual 254 squarings and 11 multiplications
+static void fe_invert(fe r, const fe a) {
+    fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+    fe_sq(z2, a);
+    fe_sqn(t, z2, 2);
+    fe_mul(z9, t, a);
+    fe_mul(z11, z9, z2);
+    fe_sq(t, z11);
+    fe_mul(z2_5_0, t, z9);
+    fe_sqn(t, z2_5_0, 5);
+    fe_mul(z2_10_0, t, z2_5_0);
+    fe_sqn(t, z2_10_0, 10);
+    fe_mul(z2_20_0, t, z2_10_0);
+    fe_sqn(t, z2_20_0, 20);
+    fe_mul(t, t, z2_20_0);
+    fe_sqn(t, t, 10);
+    fe_mul(z2_50_0, t, z2_10_0);
+    fe_sqn(t, z2_50_0, 50);
+    fe_mul(z2_100_0, t, z2_50_0);
+    fe_sqn(t, z2_100_0, 100);
+    fe_mul(t, t, z2_100_0);
+    fe_sqn(t, t, 50);
+    fe_mul(t, t, z2_50_0);
+    fe_sqn(t, t, 5);
+    fe_mul(r, t, z11);
+}
+
+// Fully reduce a into [0, p) and encode it as 32 little endian bytes
+static void fe_tobytes(uint8_t * out, const fe a) {
+    fe t;
+    memcpy(t, a, sizeof(t));
+
+    // Fold bit 255 down twice, leaving t < 2^255
+    for (int pass = 0; pass < 2; pass++) {
+        uint64_t c = (uint64_t)(t[7] >> 31) * 19;
+        t[7] &= 0x7fffffff;
+        for (int i = 0; i < 8; i++) {
+            c += t[i];
+            t[i] = (uint32_t)c;
+            c >>= 32;
+        }
+    }
+
+    // t - p = t + 19 - 2^255, if that doesn't go negative
+    fe u;
+    uint64_t c = 19;
+    for (int i = 0; i < 8; i++) {
+        c += t[i];
+        u[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    if (u[7] >> 31) {
+        u[7] &= 0x7fffffff;
+        memcpy(t, u, sizeof(t));
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = t[i];
+        out[4 * i + 1] = t[i] >> 8;
+        out[4 * i + 2] = t[i] >> 16;
+        out[4 * i + 3] = t[i] >> 24;
+    }
+}
+
+/******************** Group operations ********************/
+
+static void ge_identity(ge_p3 * p) {
+    memset(p, 0, sizeof(*p));
+    p->Y[0] = 1;
+    p->Z[0] = 1;
+}
+
+// p = 2p (dbl-2008-hwcd with a = -1, computed as (-X3 : -Y3 : -Z3 : -T3)
+// to save negating F = G - C and H = -A - B)
+static void ge_dbl(ge_p3 * p) {
+    fe a, b, c, e, f, g, h;
+
+    fe_sq(a, p->X);
+    fe_sq(b, p->Y);
+    fe_sq(c, p->Z);
+    fe_add(c, c, c);
+    fe_add(e, p->X, p->Y);
+    fe_sq(e, e);
+    fe_sub(e, e, a);
+    fe_sub(e, e, b);
+    fe_sub(g, b, a);
+    fe_sub(f, c, g);
+    fe_add(h, a, b);
+    fe_mul(p->X, e, f);
+    fe_mul(p->Y, g, h);
+    fe_mul(p->Z, f, g);
+    fe_mul(p->T, e, h);
+}
+
+// p += q, or p -= q if negate (add-2008-hwcd-3, with q affine)
+static void ge_madd(ge_p3 * p, const ed25519_precomp_t * q, int negate) {
+    fe a, b, c, d, e, f, g, h;
+
+    fe_add(a, p->Y, p->X);
+    fe_sub(b, p->Y, p->X);
+    // -q swaps y + x with y - x and negates xy2d
+    fe_mul(a, a, negate ? q->y_minus_x : q->y_plus_x);
+    fe_mul(b, b, negate ? q->y_plus_x : q->y_minus_x);
+    fe_mul(c, p->T, q->xy2d);
+    fe_add(d, p->Z, p->Z);
+    fe_sub(e, a, b);
+    fe_add(h, a, b);
+    if (negate) {
+        fe_sub(g, d, c);
+        fe_add(f, d, c);
+    } else {
+        fe_add(g, d, c);
+        fe_sub(f, d, c);
+    }
+    fe_mul(p->X, e, f);
+    fe_mul(p->Y, h, g);
+    fe_mul(p->Z, g, f);
+    fe_mul(p->T, e, h);
+}
+
+static void ge_tobytes(uint8_t * out, const ge_p3 * p) {
+    fe z_inv, x, y;
+    uint8_t x_bytes[32];
+
+    fe_invert(z_inv, p->Z);
+    fe_mul(x, p->X, z_inv);
+    fe_mul(y, p->Y, z_inv);
+    fe_tobytes(out, y);
+    fe_tobytes(x_bytes, x);
+    out[31] |= (x_bytes[0] & 1) << 7;
+}
+
+/******************** Scalars ********************/
+
+// a < order, for 32 byte little endian a
+static int sc_is_canonical(const uint8_t * a) {
+    for (int i = 7; i >= 0; i--) {
+        uint32_t w = a[4 * i] | (a[4 * i + 1] << 8) | (a[4 * i + 2] << 16) | ((uint32_t)a[4 * i + 3] << 24);
+        if (w != order[i]) {
+            return w < order[i];
+        }
+    }
+    return 0;
+}
+
+// out = in mod order, for 64 byte little endian in
+static void sc_reduce(uint8_t * out, const uint8_t * in) {
+    uint32_t r[8] = { 0 };
+
+    // The top 252 bits are already below the order, the rest go in one at a time
+    for (int bit = 511; bit >= 0; bit--) {
+        uint32_t carry = (in[bit / 8] >> (bit % 8)) & 1;
+        for (int i = 0; i < 8; i++) {
+            uint32_t top = r[i] >> 31;
+            r[i] = (r[i] << 1) | carry;
+            carry = top;
+        }
+        if (bit >= 260) {
+            continue;
+        }
+
+        int ge = 1;
+        for (int i = 7; i >= 0; i--) {
+            if (r[i] != order[i]) {
+                ge = r[i] > order[i];
+                break;
+            }
+        }
+        if (ge) {
+            uint64_t borrow = 0;
+            for (int i = 0; i < 8; i++) {
+                uint64_t d = (uint64_t)r[i] - order[i] - borrow;
+                r[i] = (uint32_t)d;
+                borrow = (d >> 32) & 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = r[i];
+        out[4 * i + 1] = r[i] >> 8;
+        out[4 * i + 2] = r[i] >> 16;
+        out[4 * i + 3] = r[i] >> 24;
+    }
+}
+
+// Width-w NAF of a 128 bit little endian scalar: odd digits in
+// [-(2^(w-1) - 1), 2^(w-1) - 1], with at least w - 1 zeros between them
+static void sc_wnaf(int8_t * naf, const uint8_t * half) {
+    int carry = 0;
+    int bit = 0;
+
+    memset(naf, 0, NAF_LEN);
+    while (bit < NAF_LEN) {
+        int b = bit < ED25519_HALF_BITS ? (half[bit / 8] >> (bit % 8)) & 1 : 0;
+        if (b == carry) {
+            bit++;
+            continue;
+        }
+
+        int window = 0;
+        for (int i = ED25519_TABLE_WINDOW - 1; i >= 0; i--) {
+            int pos = bit + i;
+            window <<= 1;
+            if (pos < ED25519_HALF_BITS) {
+                window |= (half[pos / 8] >> (pos % 8)) & 1;
+            }
+        }
+        window += carry;
+        carry = (window >> (ED25519_TABLE_WINDOW - 1)) & 1;
+        naf[bit] = window - (carry << ED25519_TABLE_WINDOW);
+        bit += ED25519_TABLE_WINDOW;
+    }
+}
+
+// p += digit * table[...]
+static void ge_add_digit(ge_p3 * p, const ed25519_precomp_t * table, int8_t digit) {
+    if (digit > 0) {
+        ge_madd(p, &table[digit / 2], 0);
+    } else if (digit < 0) {
+        ge_madd(p, &table[-digit / 2], 1);
+    }
+}
+
+/** @brief Check that precomputed tables were generated for a public key.
+ *
+ *  @param tables: const ed25519_tables_t *, Tables from gen_decoder_secrets.py.
+ *  @param pubkey: const uint8_t *, 32 byte encoded public key A.
+ *
+ *  @return int: 0 if neg_key[0] is -A, -1 otherwise.
+ */
+int ed25519_fixed_check(const ed25519_tables_t * tables, const uint8_t * pubkey) {
+    const ed25519_precomp_t * neg_key = &tables->neg_key[0];
+    fe x, y;
+    uint8_t encoded[ED25519_KEY_LEN];
+    uint8_t x_bytes[32];
+
+    // -A = (-x, y), so x = ((y - x) - (y + x)) / 2 and y = ((y + x) + (y - x)) / 2
+    fe_sub(x, neg_key->y_minus_x, neg_key->y_plus_x);
+    fe_mul(x, x, fe_half);
+    fe_add(y, neg_key->y_plus_x, neg_key->y_minus_x);
+    fe_mul(y, y, fe_half);
+
+    fe_tobytes(encoded, y);
+    fe_tobytes(x_bytes, x);
+    encoded[31] |= (x_bytes[0] & 1) << 7;
+
+    return memcmp(encoded, pubkey, sizeof(encoded)) == 0 ? 0 : -1;
+}
+
+/** @brief Verify an Ed25519 signature from the key the tables were built for.
+ *
+ *  @param tables: const ed25519_tables_t *, Tables from gen_decoder_secrets.py.
+ *  @param pubkey: const uint8_t *, 32 byte encoded public key A.
+ *  @param signature: const uint8_t *, 64 byte signature R || s.
+ *  @param msg: const uint8_t *, Signed message.
+ *  @param msg_len: size_t, Length of the message in bytes.
+ *
+ *  @return int: 0 if the signature is valid, -1 otherwise.
+ */
+int ed25519_fixed_verify(const ed25519_tables_t * tables, const uint8_t * pubkey,
+                         const uint8_t * signature, const uint8_t * msg, size_t msg_len) {
+    const uint8_t * sig_r = signature;
+    const uint8_t * sig_s = signature + 32;
+    wc_Sha512 sha;
+    uint8_t digest[WC_SHA512_DIGEST_SIZE];
+    uint8_t h[32];
+    uint8_t check[32];
+    int8_t naf[4][NAF_LEN];
+    ge_p3 p;
+
+    // Reject malleable signatures
+    if (!sc_is_canonical(sig_s)) {
+        return -1;
+    }
+
+    // h = SHA-512(R || A || M) mod L
+    if (wc_InitSha512(&sha) != 0) {
+        return -1;
+    }
+    int ret = wc_Sha512Update(&sha, sig_r, 32);
+    ret |= wc_Sha512Update(&sha, pubkey, ED25519_KEY_LEN);
+    ret |= wc_Sha512Update(&sha, msg, msg_len);
+    ret |= wc_Sha512Final(&sha, digest);
+    wc_Sha512Free(&sha);
+    if (ret != 0) {
+        return -1;
+    }
+    sc_reduce(h, digest);
+
+    // sB - hA = s_lo B + s_hi (2^128 B) + h_lo (-A) + h_hi (2^128 (-A))
+    const ed25519_precomp_t * point_tables[4] = {
+        tables->base, tables->base_hi, tables->neg_key, tables->neg_key_hi,
+    };
+    sc_wnaf(naf[0], sig_s);
+    sc_wnaf(naf[1], sig_s + ED25519_HALF_BITS / 8);
+    sc_wnaf(naf[2], h);
+    sc_wnaf(naf[3], h + ED25519_HALF_BITS / 8);
+
+    int top = NAF_LEN - 1;
+    while (top >= 0 && !naf[0][top] && !naf[1][top] && !naf[2][top] && !naf[3][top]) {
+        top--;
+    }
+
+    ge_identity(&p);
+    for (int i = top; i >= 0; i--) {
+        if (i != top) {
+            ge_dbl(&p);
+        }
+        for (int k = 0; k < 4; k++) {
+            ge_add_digit(&p, point_tables[k], naf[k][i]);
+        }
+    }
+
+    ge_tobytes(check, &p);
+    return memcmp(check, sig_r, sizeof(check)) == 0 ? 0 : -1;
+}
+
+#endif
@@ -10,7 +10,7 @@
 #include <stdint.h>
 #include "list_cmd.h"
 
-extern subscription_t * subscriptions[NUM_MAX_SUBSCRIPTIONS];
+extern active_subscription_t active_subscriptions[NUM_MAX_SUBSCRIPTIONS];
 
 /** @brief Handle list command, returning all active subscriptions over UART
  * 
@@ -26,7 +26,7 @@ void list(packet_t * packet) {
     list_response_t response = {0};
     int curr = 0;
     for (int i = 0; i < NUM_MAX_SUBSCRIPTIONS; i++) {
-        subscription_t * slot = subscriptions[i];
+        active_subscription_t * slot = &active_subscriptions[i];
         if (slot->channel) {
             response.entries[curr].channel_id = slot->channel;
             response.entries[curr].start = slot->start;
@@ -24,6 +24,7 @@
 #include "subscribe.h"
 #include "decode.h"
 #include "verify.h"
+#include "perf.h"
 
 #include "led.h"
 #define STATUS_LED_OFF(void) LED_Off(LED1); LED_Off(LED2); LED_Off(LED3);
@@ -35,13 +36,13 @@ void panic(void) {
 }
 
 #define FIRST_BOOT_FLAG_PAGE 0x10040000
-#define FIRST_BOOT_FLAG 0xAAAAAAAA
-extern subscription_t * subscriptions[NUM_MAX_SUBSCRIPTIONS];
+// Changes along with the layout of the subscription pages, so that pages
+// written by older firmware get cleared too
+#define FIRST_BOOT_FLAG 0xAAAAAAAC
 
-/** @brief Write zeroes to subscription update file pages on first boot.
+/** @brief Erase the subscription log on first boot.
  */
 void clear_subscription_pages(void) {
-    uint8_t zeroes[MXC_FLASH_PAGE_SIZE] = {0};
     uint32_t flag = FIRST_BOOT_FLAG;
     if (flag == *(uint32_t *)FIRST_BOOT_FLAG_PAGE) {
         return;
@@ -50,11 +51,7 @@ void clear_subscription_pages(void) {
     flash_simple_erase_page((uint32_t)FIRST_BOOT_FLAG_PAGE);
     flash_simple_write((uint32_t)FIRST_BOOT_FLAG_PAGE, &flag, sizeof(uint32_t));
 
-    for (int i = 0; i < NUM_MAX_SUBSCRIPTIONS; i++) {
-        uint32_t address = (uint32_t)subscriptions[i];
-        flash_simple_erase_page(address);
-        flash_simple_write(address, zeroes, MXC_FLASH_PAGE_SIZE);
-    }
+    clear_subscription_log();
 }
 
 /** @brief Initialize the ARM MPU, disabling execution in most of SRAM.
@@ -131,12 +128,18 @@ void init(void) {
     // src: msdk-2024_02/Libraries/PeriphDrivers/Source/SYS/sys_me17.c
     if (MXC_SYS_Clock_Select(MXC_SYS_CLOCK_IPO) != 0) panic();
 
+    // Count cycles for the perf counters
+    cycles_init();
+
     // Initialize the flash peripheral to enable access to persistent memory
     flash_simple_init();
 
     // Clear subscription pages on first boot
     clear_subscription_pages();
 
+    // Cache subscriptions in SRAM for the decode path
+    load_subscriptions();
+
     // Initialize signing key
     if (init_signing_key() < 0) panic();
 
@@ -144,6 +147,17 @@ void init(void) {
     if (uart_init() < 0) panic();
 }
 
+/** @brief Let the handler for a packet start on it while its body arrives.
+ * 
+ *  @param packet: const packet_t *, Pointer to the packet being read.
+ *  @param received: uint16_t, Number of body bytes received so far.
+ */
+void rx_hook(const packet_t * packet, uint16_t received) {
+    if (packet->header.opcode == OPCODE_DECODE || packet->header.opcode == OPCODE_COMPACT) {
+        decode_rx_hook(packet, received);
+    }
+}
+
 /** @brief Main command processing loop.
  */
 int main(void) {
@@ -153,8 +167,12 @@ int main(void) {
     init();
 
     while (true) {
+        // Derive the keys of the frames expected next until a packet starts
+        while (!uart_rx_ready() && decode_idle_step());
+        decode_idle_stop();
+
         // Read a packet
-        read = read_packet(&packet);
+        read = read_packet(&packet, rx_hook);
 
         // If we read an invalid packet, then continue and read another packet.
         if (read == 0) {
@@ -164,14 +182,35 @@ int main(void) {
         // Parse the packet for a valid header.
         switch (packet.header.opcode) {
             case OPCODE_LIST:
+                // A LIST starts a session over, so a host that never negotiates
+                // isn't held to the window an earlier one left behind
+                reset_window();
                 list(&packet);
                 continue;
             case OPCODE_SUBSCRIBE:
                 subscribe(&packet, read);
                 continue;
             case OPCODE_DECODE:
+            case OPCODE_COMPACT:
                 decode(&packet, read);
                 continue;
+            case OPCODE_BATCH:
+                decode_batch(&packet, read);
+                continue;
+            case OPCODE_ROOT:
+                decode_root(&packet, read);
+                continue;
+            case OPCODE_PATH:
+                decode_path(&packet, read);
+                continue;
+            case OPCODE_WINDOW:
+                negotiate_window(&packet, read);
+                continue;
+#if PERF_COUNTERS
+            case OPCODE_DEBUG:
+                perf_query(&packet, read);
+                continue;
+#endif
             default:
                 send_error();
         };
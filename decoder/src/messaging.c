@@ -8,23 +8,101 @@
  */
 
 #include "messaging.h"
+#include "perf.h"
+
+// Bytes either side sends between ACKs
+static uint16_t window = DEFAULT_WINDOW;
+
+/** @brief Check whether an ACK is due before receiving the next byte.
+ * 
+ *  A host that stops sending where a DEFAULT_WINDOW host would wait for an
+ *  ACK, for WINDOW_TIMEOUT_US, never negotiated the window in use (it is a
+ *  new session with a host that doesn't), so the window falls back to
+ *  DEFAULT_WINDOW and the ACK is sent after all.
+ * 
+ *  @param received: uint16_t, Bytes received so far.
+ * 
+ *  @return bool: true if an ACK is due.
+ */
+static bool ack_due(uint16_t received) {
+    if (received == 0) {
+        return false;
+    } else if (received % window == 0) {
+        return true;
+    } else if (window == DEFAULT_WINDOW || received % DEFAULT_WINDOW != 0) {
+        return false;
+    }
+
+    uint32_t start = cycles_now();
+    uint32_t timeout = WINDOW_TIMEOUT_US * cycles_per_us();
+    while (!uart_rx_ready()) {
+        if (cycles_now() - start > timeout) {
+            reset_window();
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @brief Read a packet's body over UART, reporting progress as it arrives.
+ * 
+ *  @param packet: packet_t *, Pointer to the packet, with its header already read.
+ *  @param hook: rx_hook_t, Called after each body byte, or NULL.
+ * 
+ *  @return int: Number of bytes read.
+ */
+static int read_body(packet_t * packet, rx_hook_t hook) {
+    uint16_t len = packet->header.length;
+    int i = 0;
+
+    if (hook == NULL) {
+        return read_bytes(packet->body, len);
+    } else if (len == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (ack_due(i)) {
+            send_ack();
+        }
+        packet->body[i] = (uint8_t)uart_readbyte();
+        hook(packet, i + 1);
+    }
+
+    send_ack();
+
+    return i;
+}
 
 /** @brief Read a well-formed packet over UART.
  * 
  *  @param packet: packet_t *, Pointer to the packet to be read into.
+ *  @param hook: rx_hook_t, Called as each body byte arrives, or NULL.
+ * 
+ *  @note Handlers decrypt in place, so only the bytes the previous packet
+ *      occupied are cleared; everything past them is still zero.
  * 
  *  @return int: Number of bytes read into the packet.
  */
-int read_packet(packet_t * packet) {
+int read_packet(packet_t * packet, rx_hook_t hook) {
+    static uint16_t last_len = sizeof(packet_t);
     int read = 0;
-    memset(packet, 0, sizeof(packet_t));
+    memset(packet, 0, last_len);
+    last_len = sizeof(header_t);
 
-    // Read the Header
-    read += read_bytes(packet->rawBytes, sizeof(header_t));
+    // Read the Header, timed from its first byte so that time spent waiting
+    // for the host doesn't count
+    packet->rawBytes[0] = (uint8_t)uart_readbyte();
+    uint32_t start = PERF_START();
+    read += 1 + read_bytes(&packet->rawBytes[1], sizeof(header_t) - 1);
+    PERF_RECORD(PERF_HEADER, start);
 
     // Read the Body
     if (packet->header.length <= BODY_LEN) {
-        read += read_bytes(packet->body, packet->header.length);
+        last_len += packet->header.length;
+        start = PERF_START();
+        read += read_body(packet, hook);
+        PERF_RECORD(PERF_BODY, start);
         return read;
     }
 
@@ -32,7 +110,7 @@ int read_packet(packet_t * packet) {
     // we can easily continue receiving packets. Mostly so a lack of this isn't
     // construed as an attempt to lock out an attacker.
     for (uint16_t i = 0; i < packet->header.length; i++) {
-        if (i && i % 256 == 0) {
+        if (ack_due(i)) {
             send_ack();
         }
         uart_readbyte();
@@ -44,6 +122,52 @@ int read_packet(packet_t * packet) {
     return 0;
 }
 
+/** @brief Handle a window negotiation command, agreeing on how many bytes
+ *      either side sends between ACKs from the next packet on.
+ * 
+ *  The body is the window the host asks for, as a uint16_t. The response body
+ *  is the window granted, which is the request clamped to
+ *  [DEFAULT_WINDOW, MAX_WINDOW]. It lasts until the next error or LIST, or
+ *  until the host stalls as a DEFAULT_WINDOW host would (see ack_due()).
+ * 
+ *  @param packet: packet_t *, Pointer to the packet to be read from.
+ *  @param len: uint16_t, Length of the packet in bytes.
+ */
+void negotiate_window(packet_t * packet, uint16_t len) {
+    uint16_t requested;
+
+    if (len != sizeof(header_t) + sizeof(requested)) {
+        send_error();
+        return;
+    }
+
+    memcpy(&requested, packet->body, sizeof(requested));
+    if (requested < DEFAULT_WINDOW) {
+        requested = DEFAULT_WINDOW;
+    } else if (requested > MAX_WINDOW) {
+        requested = MAX_WINDOW;
+    }
+
+    // The response is shorter than any window, so it doesn't matter which one it goes out under
+    memcpy(packet->body, &requested, sizeof(requested));
+    if (send_packet(packet->body, sizeof(requested), OPCODE_WINDOW) == sizeof(requested)) {
+        window = requested;
+    }
+}
+
+/** @brief Go back to DEFAULT_WINDOW, as at the start of a session.
+ */
+void reset_window(void) {
+    window = DEFAULT_WINDOW;
+}
+
+/** @brief Send an error, which also ends any negotiated window.
+ */
+void send_error(void) {
+    reset_window();
+    send_header(OPCODE_ERROR, 0);
+}
+
 /** @brief Send a well-formed packet over UART.
  * 
  *  @param buf: uint8_t *, Pointer to packet body to read from.
@@ -53,12 +177,37 @@ int read_packet(packet_t * packet) {
  *  @return int: Number of bytes of body written.
  */
 int send_packet(uint8_t * buf, uint16_t len, uint8_t opcode) {
-    if (!send_header(opcode, len)) {
-        return 0;
+    uint32_t start = PERF_START();
+    int sent = 0;
+
+    if (send_header(opcode, len)) {
+        sent = send_bytes(buf, len);
     }
 
-    return send_bytes(buf, len);
+    PERF_RECORD(PERF_SEND, start);
+    return sent;
+}
+
+#if PERF_COUNTERS
+/** @brief Send a debug packet over UART.
+ * 
+ *  The host doesn't ACK debug packets, so the body goes out in one go
+ *  whatever the window.
+ * 
+ *  @param buf: uint8_t *, Pointer to packet body to read from.
+ *  @param len: uint16_t, Number of bytes from body to read.
+ */
+void send_debug(uint8_t * buf, uint16_t len) {
+    uart_writebyte(MAGIC_BYTE);
+    uart_writebyte(OPCODE_DEBUG);
+    uart_writebyte(len & 0xff);
+    uart_writebyte(len >> 8);
+
+    for (uint16_t i = 0; i < len; i++) {
+        uart_writebyte(buf[i]);
+    }
 }
+#endif
 
 /** @brief Send a packet header over UART.
  * 
@@ -111,7 +260,7 @@ int read_bytes(uint8_t * buf, uint16_t len) {
     }
 
     for (i = 0; i < len; i++) {
-        if (i && i % 256 == 0) {
+        if (ack_due(i)) {
             send_ack();
         }
         buf[i] = (uint8_t)uart_readbyte();
@@ -138,7 +287,7 @@ int send_bytes(uint8_t * buf, uint16_t len) {
     }
 
     for (i = 0; i < len; i++) {
-        if (i && i % 256 == 0) {
+        if (i && i % window == 0) {
             if (!read_ack()) {
                 send_error();
                 memset(buf, 0, len);
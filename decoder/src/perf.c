@@ -0,0 +1,79 @@
+/**
+ * @file "perf.c"
+ * @author MIT TechSec
+ * @brief Performance counters, reported over debug packets
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#include <string.h>
+#include "perf.h"
+#include "decode.h"
+#include "cryptosystem.h"
+
+#if PERF_COUNTERS
+
+_Static_assert(sizeof(perf_report_t) <= BODY_LEN, "perf report must fit in one packet");
+
+static perf_histogram_t histograms[PERF_PHASES] = {0};
+
+/** @brief Add a duration to a phase's histogram.
+ * 
+ *  @param phase: perf_phase_t, Phase that was timed.
+ *  @param ticks: uint32_t, Its duration in cycle counter ticks.
+ */
+void perf_record(perf_phase_t phase, uint32_t ticks) {
+    perf_histogram_t * histogram = &histograms[phase];
+    uint8_t bucket = ticks ? 31 - __builtin_clz(ticks) : 0;
+
+    histogram->count++;
+    histogram->total += ticks;
+    if (ticks > histogram->max)
+        histogram->max = ticks;
+    histogram->buckets[bucket]++;
+}
+
+/** @brief Handle a perf query, returning the histograms in a debug packet.
+ * 
+ *  The body is empty, or one byte of PERF_QUERY_* flags. The response is a
+ *  perf_report_t, sent as a debug packet so the host doesn't ACK it.
+ * 
+ *  @param packet: packet_t *, Pointer to the packet to be read from.
+ *  @param len: uint16_t, Length of the packet in bytes.
+ */
+void perf_query(packet_t * packet, uint16_t len) {
+    static perf_report_t report;
+    kdf_cache_stats_t kdf_stats;
+    predict_stats_t predict_stats;
+
+    if (len > sizeof(header_t) + sizeof(uint8_t)) {
+        send_error();
+        return;
+    }
+    uint8_t flags = len > sizeof(header_t) ? packet->body[0] : 0;
+
+    get_kdf_cache_stats(&kdf_stats);
+    get_predict_stats(&predict_stats);
+
+    report.ticks_per_us = cycles_per_us();
+    report.n_phases = PERF_PHASES;
+    report.n_buckets = PERF_BUCKETS;
+    memcpy(report.phases, histograms, sizeof(histograms));
+    report.kdf_hits = kdf_stats.hits;
+    report.kdf_misses = kdf_stats.misses;
+    report.kdf_digests = kdf_stats.digests;
+    report.predict_hits = predict_stats.hits;
+    report.predict_misses = predict_stats.misses;
+    report.predict_derived = predict_stats.derived;
+
+    if (flags & PERF_QUERY_RESET) {
+        memset(histograms, 0, sizeof(histograms));
+        reset_kdf_cache_stats();
+        reset_predict_stats();
+    }
+
+    send_debug((uint8_t *)&report, sizeof(report));
+}
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file "simple_cycles.c"
+ * @author MIT TechSec
+ * @brief Cycle counter, backed by the Cortex-M4 DWT
+ * @date 2025
+ *
+ * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
+ */
+
+#include "simple_cycles.h"
+#include "mxc_device.h"
+
+/** @brief Starts the cycle counter.
+ * 
+ *  @note This function should be called once upon startup, after the
+ *      system clock is selected.
+*/
+void cycles_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/** @brief Reads the cycle counter.
+ * 
+ *  @note The counter wraps around, so only the difference between two
+ *      readings is meaningful.
+ *  @return The current count.
+*/
+uint32_t cycles_now(void) {
+    return DWT->CYCCNT;
+}
+
+/** @brief Counter ticks per microsecond.
+ * 
+ *  @return The core clock in MHz.
+*/
+uint32_t cycles_per_us(void) {
+    return SystemCoreClock / 1000000;
+}
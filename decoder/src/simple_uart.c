@@ -57,6 +57,14 @@ int uart_readbyte(void){
     return data;
 }
 
+/** @brief Checks whether a received character is waiting to be read.
+ * 
+ *  @return true if uart_readbyte() would return without blocking.
+*/
+bool uart_rx_ready(void){
+    return MXC_UART_GetRXFIFOAvailable(MXC_UART_GET_UART(CONSOLE_UART)) > 0;
+}
+
 /** @brief Writes a byte to UART.
  * 
  *  @param data The byte to be written.
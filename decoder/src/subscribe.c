@@ -7,48 +7,399 @@
  * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
  */
 
+#include <stddef.h>
 #include "subscribe.h"
+#include "decode.h"
 #include "decrypt.h"
 #include "verify.h"
 
-const subscription_t * const subscriptions[NUM_MAX_SUBSCRIPTIONS] = {
-    (subscription_t *)SUB1,
-    (subscription_t *)SUB2,
-    (subscription_t *)SUB3,
-    (subscription_t *)SUB4,
-    (subscription_t *)SUB5,
-    (subscription_t *)SUB6,
-    (subscription_t *)SUB7,
-    (subscription_t *)SUB8,
-};
-
-/** @brief Locate a subscription file in memory
- * 
- *  @param channel: uint32_t, Channel number of the subscription to find.
- *  @param empty_ok: bool, Whether to return an open subscription slot.
- * 
- *  @return subscription_t *: pointer to the subscription file in memory, NULL if not found.
+// Room for a decrypted update, which expands in place
+#define SUB_CIPHERTEXT_LEN sizeof(((enc_subscription_t *)0)->ciphertext)
+
+// Longest compact subscription, i.e. longest record body
+#define SUB_RECORD_MAX_LEN (SUBSCRIPTION_HEADER_LEN + SUBSCRIPTION_MAX_NODES * sizeof(aeskey_t))
+
+_Static_assert(SUBSCRIPTION_HEADER_LEN + SUBSCRIPTION_MAX_NODES * sizeof(kdf_node_t)
+                   <= SUB_CIPHERTEXT_LEN - SIGNATURE_LEN,
+               "worst case subscription must fit in one subscription update, and expand in place");
+_Static_assert(SUB_LOG_ALIGN(SUB_RECORD_MAX_LEN) <= sizeof(subscription_t),
+               "record bodies are padded to whole lines in place");
+_Static_assert(sizeof(sub_log_line_t) == SUB_LOG_LINE, "log lines are one flash line");
+_Static_assert(SUB_LOG_HALF(2) <= SUB_FLASH_START + 15 * MXC_FLASH_PAGE_SIZE,
+               "both log halves must fit in the subscription pages");
+_Static_assert(sizeof(sub_log_line_t)
+                   + NUM_MAX_SUBSCRIPTIONS * SUB_LOG_RECORD_SIZE(SUBSCRIPTION_HEADER_LEN)
+                   + SUB_POOL_NODES * sizeof(aeskey_t)
+                   + SUB_LOG_RECORD_SIZE(SUB_RECORD_MAX_LEN) <= SUB_LOG_HALF_SIZE,
+               "a compacted live set must leave room for one more record");
+
+// Working set, one entry per subscribed channel, plus an open-addressed
+// channel table holding (entry number + 1) so that 0 marks an empty bucket
+active_subscription_t active_subscriptions[NUM_MAX_SUBSCRIPTIONS] = { 0 };
+static uint8_t channel_table[SUB_TABLE_BUCKETS] = { 0 };
+
+// Nodes and index entries of the working set, packed in the order of first
+static kdf_node_t node_pool[SUB_POOL_NODES] = { 0 };
+static kdf_index_entry_t entry_pool[SUB_POOL_NODES] = { 0 };
+static uint16_t pool_used = 0;
+
+// Active log half, its generation, where the next record goes within it, and
+// the sequence number of the newest record
+static uint8_t log_half = 0;
+static uint32_t log_generation = 0;
+static uint32_t log_tail = SUB_LOG_HALF_SIZE;
+static uint32_t log_seq = 0;
+
+// Staging for records rewritten by compaction
+static subscription_t record_buffer = { 0 };
+
+#define CHANNEL_BUCKET(channel) (((uint32_t)(channel) * 2654435761u) % SUB_TABLE_BUCKETS)
+
+/** @brief Get a line of a log half.
+ *
+ *  @param half: uint8_t, Log half to read.
+ *  @param offset: uint32_t, Offset of the line within the half.
+ *
+ *  @return const sub_log_line_t *: pointer to the line in flash.
+ */
+static const sub_log_line_t * log_line(uint8_t half, uint32_t offset) {
+    return (const sub_log_line_t *)(SUB_LOG_HALF(half) + offset);
+}
+
+/** @brief Erase the pages of a log half that have been written to.
+ *
+ *  Blank pages are skipped, as most of a half is after a compaction.
+ *
+ *  @param half: uint8_t, Log half to erase.
+ */
+static void erase_half(uint8_t half) {
+    for (uint32_t page = 0; page < SUB_LOG_HALF_PAGES; page++) {
+        const uint32_t * words = (const uint32_t *)(SUB_LOG_HALF(half) + page * MXC_FLASH_PAGE_SIZE);
+        for (uint32_t i = 0; i < MXC_FLASH_PAGE_SIZE / sizeof(uint32_t); i++) {
+            if (words[i] != 0xffffffff) {
+                flash_simple_erase_page((uint32_t)words);
+                break;
+            }
+        }
+    }
+}
+
+/** @brief Write a log line to flash.
+ *
+ *  @param address: uint32_t, Address of the line.
+ *  @param magic: uint32_t, Kind of line.
+ *  @param seq: uint32_t, Sequence number of the record, or generation of the half.
+ *  @param length: uint16_t, Length of the record body.
+ */
+static void write_line(uint32_t address, uint32_t magic, uint32_t seq, uint16_t length) {
+    sub_log_line_t line = { .magic = magic, .seq = seq, .length = length };
+    flash_simple_write(address, &line, sizeof(line));
+}
+
+/** @brief Find the working set entry of a channel.
+ *
+ *  @param channel: channel_id_t, Channel to look for, or 0 for a free entry.
+ *
+ *  @return int: entry number, -1 if not found.
+ */
+static int find_entry(channel_id_t channel) {
+    for (int i = 0; i < NUM_MAX_SUBSCRIPTIONS; i++) {
+        if (active_subscriptions[i].channel == channel)
+            return i;
+    }
+    return -1;
+}
+
+/** @brief Check whether a subscription fits in the working set.
+ *
+ *  @param channel: channel_id_t, Channel of the subscription, whose current one it replaces.
+ *  @param n_nodes: uint8_t, Number of nodes in the subscription.
+ *
+ *  @return bool: true if it fits.
+ */
+static bool fits_working_set(channel_id_t channel, uint8_t n_nodes) {
+    int i = find_entry(channel);
+    uint16_t used = pool_used;
+
+    if (i >= 0) {
+        used -= active_subscriptions[i].n_nodes;
+    } else if (find_entry(0) < 0) {
+        return false;
+    }
+    return used + n_nodes <= SUB_POOL_NODES;
+}
+
+/** @brief Remove an entry from the working set, packing the pools.
+ *
+ *  @param i: int, Entry number to remove.
+ */
+static void drop_entry(int i) {
+    active_subscription_t * active = &active_subscriptions[i];
+    uint16_t first = active->first;
+    uint16_t n = active->n_nodes;
+    uint16_t rest = pool_used - first - n;
+
+    memmove(&node_pool[first], &node_pool[first + n], rest * sizeof(kdf_node_t));
+    memmove(&entry_pool[first], &entry_pool[first + n], rest * sizeof(kdf_index_entry_t));
+    pool_used -= n;
+    memset(&node_pool[pool_used], 0, n * sizeof(kdf_node_t));
+    memset(&entry_pool[pool_used], 0, n * sizeof(kdf_index_entry_t));
+
+    for (int j = 0; j < NUM_MAX_SUBSCRIPTIONS; j++) {
+        if (active_subscriptions[j].channel != 0 && active_subscriptions[j].first > first)
+            active_subscriptions[j].first -= n;
+    }
+    memset(active, 0, sizeof(*active));
+}
+
+/** @brief Load a log record into the working set.
+ *
+ *  Records hold subscriptions in the compact form, so the node positions are
+ *  rebuilt from the window here. A record replaces an older one for the same
+ *  channel, and is ignored if the working set holds a newer one.
+ *
+ *  @param sub: const subscription_t *, Compact subscription in flash.
+ *  @param len: uint16_t, Length of the record body.
+ *  @param seq: uint32_t, Sequence number of the record.
+ *
+ *  @return int: 0 on success, -1 if the record is malformed or doesn't fit.
+ */
+static int load_record(const subscription_t * sub, uint16_t len, uint32_t seq) {
+    if (sub->channel == 0 || sub->n_nodes > SUBSCRIPTION_MAX_NODES ||
+        len != SUBSCRIPTION_HEADER_LEN + sub->n_nodes * sizeof(aeskey_t))
+        return -1;
+
+    int i = find_entry(sub->channel);
+    if (i >= 0 && active_subscriptions[i].seq >= seq)
+        return 0;
+    if (!fits_working_set(sub->channel, sub->n_nodes))
+        return -1;
+
+    if (i >= 0)
+        drop_entry(i);
+    i = find_entry(0);
+
+    active_subscription_t * active = &active_subscriptions[i];
+    kdf_node_t * nodes = &node_pool[pool_used];
+    for (int n = 0; n < sub->n_nodes; n++) {
+        memcpy(&nodes[n].key, &sub->keys[n], sizeof(aeskey_t));
+    }
+    if (cover_nodes(nodes, sub->n_nodes, sub->start, sub->end, false) != 0 ||
+        build_index_entries(nodes, sub->n_nodes, &entry_pool[pool_used]) != 0) {
+        memset(nodes, 0, sub->n_nodes * sizeof(kdf_node_t));
+        return -1;
+    }
+
+    active->first = pool_used;
+    active->n_nodes = sub->n_nodes;
+    active->start = sub->start;
+    active->end = sub->end;
+    active->seq = seq;
+    active->channel = sub->channel;
+    pool_used += sub->n_nodes;
+    return 0;
+}
+
+/** @brief Append a record to the active log half.
+ *
+ *  @param sub: subscription_t *, Compact subscription, padded in place to whole lines.
+ *  @param len: uint16_t, Length of the compact subscription.
+ *  @param seq: uint32_t, Sequence number of the record.
+ *
+ *  @return const subscription_t *: the record body in flash, NULL if the half is full.
+ */
+static const subscription_t * append_record(subscription_t * sub, uint16_t len, uint32_t seq) {
+    uint16_t body_len = SUB_LOG_ALIGN(len);
+    if (log_tail + SUB_LOG_RECORD_SIZE(len) > SUB_LOG_HALF_SIZE)
+        return NULL;
+
+    uint32_t address = SUB_LOG_HALF(log_half) + log_tail;
+    memset(&sub->rawBytes[len], 0xff, body_len - len);
+
+    write_line(address, SUB_LOG_RECORD_MAGIC, seq, len);
+    flash_simple_write(address + sizeof(sub_log_line_t), sub->rawBytes, body_len);
+    write_line(address + sizeof(sub_log_line_t) + body_len, SUB_LOG_COMMIT_MAGIC, seq, 0);
+
+    log_tail += SUB_LOG_RECORD_SIZE(len);
+    return (const subscription_t *)(address + sizeof(sub_log_line_t));
+}
+
+/** @brief Rewrite the live set into the other log half, then erase the full one.
+ *
+ *  The new half's header is written last, so an interrupted compaction
+ *  leaves the old half in charge at the next boot.
+ *
+ *  @return int: 0 on success, -1 on failure.
  */
-subscription_t * find_subscription(uint32_t channel, bool empty_ok) {
-    subscription_t * last_empty = NULL;
+static int compact_log(void) {
+    uint8_t old_half = log_half;
+
+    log_half = !old_half;
+    log_tail = sizeof(sub_log_line_t);
+    erase_half(log_half);
 
     for (int i = 0; i < NUM_MAX_SUBSCRIPTIONS; i++) {
-        subscription_t * slot = subscriptions[i];
-        if (slot->channel == 0)
-            last_empty = slot;
+        const active_subscription_t * active = &active_subscriptions[i];
+        if (active->channel == 0)
+            continue;
 
-        if (slot->channel == channel)
-            return slot;
+        record_buffer.channel = active->channel;
+        record_buffer.start = active->start;
+        record_buffer.end = active->end;
+        record_buffer.n_nodes = active->n_nodes;
+        for (int n = 0; n < active->n_nodes; n++) {
+            memcpy(&record_buffer.keys[n], &node_pool[active->first + n].key, sizeof(aeskey_t));
+        }
+
+        uint16_t len = SUBSCRIPTION_HEADER_LEN + active->n_nodes * sizeof(aeskey_t);
+        if (append_record(&record_buffer, len, active->seq) == NULL) {
+            memset(&record_buffer, 0, sizeof(record_buffer));
+            log_half = old_half;
+            log_tail = SUB_LOG_HALF_SIZE;
+            return -1;
+        }
     }
+    memset(&record_buffer, 0, sizeof(record_buffer));
+
+    write_line(SUB_LOG_HALF(log_half), SUB_LOG_HALF_MAGIC, ++log_generation, 0);
+    erase_half(old_half);
+    return 0;
+}
+
+/** @brief Load the committed records of the active log half, oldest first.
+ *
+ *  The log ends at the first erased line. Records without their commit line
+ *  are skipped. A malformed header line means an append was torn, so the
+ *  half is treated as full and gets compacted on the next update.
+ */
+static void scan_log(void) {
+    uint32_t offset = sizeof(sub_log_line_t);
 
-    if (empty_ok)
-        return last_empty;
+    while (offset + sizeof(sub_log_line_t) <= SUB_LOG_HALF_SIZE) {
+        const sub_log_line_t * line = log_line(log_half, offset);
+        if (line->magic == 0xffffffff)
+            break;
+
+        if (line->magic != SUB_LOG_RECORD_MAGIC || line->length > SUB_RECORD_MAX_LEN ||
+            offset + SUB_LOG_RECORD_SIZE(line->length) > SUB_LOG_HALF_SIZE) {
+            offset = SUB_LOG_HALF_SIZE;
+            break;
+        }
+
+        const sub_log_line_t * commit =
+            log_line(log_half, offset + sizeof(sub_log_line_t) + SUB_LOG_ALIGN(line->length));
+        if (commit->magic == SUB_LOG_COMMIT_MAGIC && commit->seq == line->seq) {
+            load_record((const subscription_t *)(line + 1), line->length, line->seq);
+            if (line->seq > log_seq)
+                log_seq = line->seq;
+        }
+        offset += SUB_LOG_RECORD_SIZE(line->length);
+    }
+
+    log_tail = offset;
+}
+
+/** @brief Rebuild the channel lookup table from the working set.
+ */
+static void rebuild_channel_table(void) {
+    memset(channel_table, 0, sizeof(channel_table));
+
+    for (int i = 0; i < NUM_MAX_SUBSCRIPTIONS; i++) {
+        if (active_subscriptions[i].channel == 0)
+            continue;
+
+        uint32_t bucket = CHANNEL_BUCKET(active_subscriptions[i].channel);
+        while (channel_table[bucket] != 0)
+            bucket = (bucket + 1) % SUB_TABLE_BUCKETS;
+        channel_table[bucket] = i + 1;
+    }
+}
+
+/** @brief Erase the subscription log and start an empty one in the first half.
+ */
+void clear_subscription_log(void) {
+    erase_half(0);
+    erase_half(1);
+
+    log_half = 0;
+    log_generation = 1;
+    log_tail = sizeof(sub_log_line_t);
+    log_seq = 0;
+    write_line(SUB_LOG_HALF(0), SUB_LOG_HALF_MAGIC, log_generation, 0);
+}
+
+/** @brief Rebuild the SRAM working set from the subscription log.
+ *
+ *  @note Flash stays the source of truth; call this once at boot.
+ */
+void load_subscriptions(void) {
+    memset(active_subscriptions, 0, sizeof(active_subscriptions));
+    memset(node_pool, 0, sizeof(node_pool));
+    memset(entry_pool, 0, sizeof(entry_pool));
+    pool_used = 0;
+    log_seq = 0;
+
+    // Both halves have a header if compaction was cut short after writing
+    // the new one, which is then complete
+    const sub_log_line_t * a = log_line(0, 0);
+    const sub_log_line_t * b = log_line(1, 0);
+    bool valid_a = a->magic == SUB_LOG_HALF_MAGIC;
+    bool valid_b = b->magic == SUB_LOG_HALF_MAGIC;
+
+    if (!valid_a && !valid_b) {
+        clear_subscription_log();
+    } else {
+        log_half = valid_b && (!valid_a || b->seq > a->seq);
+        log_generation = log_line(log_half, 0)->seq;
+        erase_half(!log_half);
+        scan_log();
+    }
+
+    rebuild_channel_table();
+}
+
+/** @brief Locate a subscription in the SRAM working set
+ *
+ *  @param channel: uint32_t, Channel number of the subscription to find.
+ *
+ *  @return const active_subscription_t *: pointer to the working set entry, NULL if not found.
+ */
+const active_subscription_t * find_active_subscription(uint32_t channel) {
+    if (channel == 0)
+        return NULL;
+
+    uint32_t bucket = CHANNEL_BUCKET(channel);
+    for (int i = 0; i < SUB_TABLE_BUCKETS && channel_table[bucket] != 0; i++) {
+        const active_subscription_t * active = &active_subscriptions[channel_table[bucket] - 1];
+        if (active->channel == channel)
+            return active;
+        bucket = (bucket + 1) % SUB_TABLE_BUCKETS;
+    }
 
     return NULL;
 }
 
+/** @brief Find the working set node that is a parent of a timestamp
+ *
+ *  @param active: const active_subscription_t *, Working set entry to search.
+ *  @param ts: timestamp_t, Timestamp of the frame.
+ *
+ *  @return const kdf_node_t *: pointer to the parent node, NULL if ts isn't covered.
+ */
+const kdf_node_t * find_active_parent(const active_subscription_t * active, timestamp_t ts) {
+    int node = find_ts_entry(&entry_pool[active->first], active->n_nodes, ts);
+    if (node < 0 || node >= active->n_nodes)
+        return NULL;
+    return &node_pool[active->first + node];
+}
+
 /** @brief Handle a received subscription update file
- * 
+ *
+ *  The update lists its nodes either in full, with each node's level, index
+ *  and key, or in the compact form, with only the keys in the order of the
+ *  minimal cover of [start, end]. Either way it is appended to the log
+ *  compact.
+ *
  *  @param packet: packet_t *, Pointer to the packet to be read from.
  *  @param len: uint16_t, Length of the packet in bytes.
  */
@@ -59,29 +410,45 @@ void subscribe(packet_t * packet, uint16_t len) {
         return;
     }
 
-    // Decrypt into buffer
+    // Decrypt in place
     uint16_t sub_len = 0;
     subscription_t * sub = decrypt_subscription(packet, len, &sub_len);
 
     if (sub != NULL && sub_len > 0) {
-        // Sanity checks
-        if (sub->channel == 0) {
+        // Sanity checks, and node positions for a compact update
+        if (sub->channel == 0 || expand_subscription(sub, sub_len) != 0 ||
+            !fits_working_set(sub->channel, sub->n_nodes)) {
+            memset(sub->rawBytes, 0, SUB_CIPHERTEXT_LEN);
             send_error();
             return;
         }
+        sub_len = compact_subscription(sub);
 
-        // Find appropriate buf to copy into
-        subscription_t * slot = find_subscription(sub->channel, true);
+        // Only a full half costs any erases
+        const subscription_t * record = NULL;
+        if (log_tail + SUB_LOG_RECORD_SIZE(sub_len) <= SUB_LOG_HALF_SIZE || compact_log() == 0)
+            record = append_record(sub, sub_len, log_seq + 1);
 
-        if (slot != NULL) {
-            // Erase the appropriate page
-            flash_simple_erase_page((uint32_t)slot);
-            flash_simple_write((uint32_t)slot, sub->rawBytes, sub_len);
+        // Wipe the decrypted keys out of the packet
+        memset(sub->rawBytes, 0, SUB_CIPHERTEXT_LEN);
 
-            send_header(OPCODE_SUBSCRIBE, 0);
-            return;
+        if (record != NULL) {
+            log_seq++;
+
+            // Refresh the working set from what actually landed in flash
+            int ret = load_record(record, sub_len, log_seq);
+            rebuild_channel_table();
+
+            // Don't derive from a path cached under the old subscription
+            invalidate_kdf_cache(record->channel);
+            invalidate_predicted_keys(record->channel);
+
+            if (ret == 0) {
+                send_header(OPCODE_SUBSCRIBE, 0);
+                return;
+            }
         }
     }
 
     send_error();
-}
\ No newline at end of file
+}
@@ -7,11 +7,36 @@
  * @copyright Copyright (c) 2025 Massachusetts Institute of Technology
  */
 
+#include <stdbool.h>
+#include <string.h>
 #include "verify.h"
+#include "perf.h"
+
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
 
 extern const uint8_t SK_BYTES[32];
+#if ED25519_FIXED_TABLES
+// Precomputed from SK_BYTES by gen_decoder_secrets.py, kept in flash
+extern const ed25519_tables_t ED25519_TABLES;
+#else
 static ed25519_key signing_key = {0};
+#endif
+
+// Merkle roots whose signatures checked out, replaced oldest first
+static uint8_t verified_roots[ROOT_CACHE_SLOTS][MERKLE_HASH_LEN] = {0};
+static bool root_valid[ROOT_CACHE_SLOTS] = {0};
+static int next_root_slot = 0;
 
+#if ED25519_FIXED_TABLES
+/** @brief Check the precomputed verification tables belong to the signing key.
+ * 
+ *  @return int: 0 on success, -1 if the tables were built for another key.
+ */
+int init_signing_key(void) {
+    return ed25519_fixed_check(&ED25519_TABLES, SK_BYTES);
+}
+#else
 /** @brief Initialize wolfcrypt ed25519 signing key object.
  * 
  *  @return int: 0 on success, otherwise a wolfcrypt error code.
@@ -24,6 +49,7 @@ int init_signing_key(void) {
 
     return wc_ed25519_import_public(SK_BYTES, sizeof(SK_BYTES), &signing_key);
 }
+#endif
 
 /** @brief Verify a packet is signed with the encoder's signing key.
  * 
@@ -33,9 +59,6 @@ int init_signing_key(void) {
  *  @return int: 0 on success, -1 on failure.
  */
 int verify_packet(packet_t * packet, uint16_t len) {
-    int ret;
-    int verified;
-
     // Ensure packet is not larger than expected.
     if (len > sizeof(packet_t)) {
         return -1;
@@ -46,13 +69,117 @@ int verify_packet(packet_t * packet, uint16_t len) {
         return -1;
     }
 
-    byte * signature = &packet->rawBytes[len - SIGNATURE_LEN];
+    uint8_t * signature = &packet->rawBytes[len - SIGNATURE_LEN];
+
+    uint32_t start = PERF_START();
+#if ED25519_FIXED_TABLES
+    int ret = ed25519_fixed_verify(&ED25519_TABLES, SK_BYTES, signature, packet->rawBytes, len - SIGNATURE_LEN);
+#else
+    int verified = 0;
+    int ret = wc_ed25519_verify_msg(signature, SIGNATURE_LEN, packet->rawBytes, len - SIGNATURE_LEN, &verified, &signing_key);
+    ret = (ret == 0 && verified == 1) ? 0 : -1;
+#endif
+    PERF_RECORD(PERF_VERIFY, start);
+    return ret;
+}
 
-    ret = wc_ed25519_verify_msg(signature, SIGNATURE_LEN, packet->rawBytes, len - SIGNATURE_LEN, &verified, &signing_key);
+/** @brief Verify a signed Merkle root and remember it for verify_merkle_path().
+ * 
+ *  The body is the MERKLE_HASH_LEN byte root followed by a signature over the
+ *  whole packet. Verifying a root that is already cached leaves the cache as is.
+ * 
+ *  @param packet: packet_t *, Pointer to the root packet.
+ *  @param len: uint16_t, Length of the root packet in bytes.
+ * 
+ *  @return int: 0 on success, -1 on failure.
+ */
+int verify_root_packet(packet_t * packet, uint16_t len) {
+    if (len != sizeof(header_t) + MERKLE_HASH_LEN + SIGNATURE_LEN || verify_packet(packet, len) != 0) {
+        return -1;
+    }
 
-    if (ret == 0 && verified == 1) {
-        return 0;
+    for (int i = 0; i < ROOT_CACHE_SLOTS; i++) {
+        if (root_valid[i] && memcmp(verified_roots[i], packet->body, MERKLE_HASH_LEN) == 0) {
+            return 0;
+        }
     }
 
+    memcpy(verified_roots[next_root_slot], packet->body, MERKLE_HASH_LEN);
+    root_valid[next_root_slot] = true;
+    next_root_slot = (next_root_slot + 1) % ROOT_CACHE_SLOTS;
+    return 0;
+}
+
+/** @brief Hash a Merkle tree leaf or interior node, truncated to MERKLE_HASH_LEN.
+ * 
+ *  @param prefix: uint8_t, MERKLE_LEAF_PREFIX or MERKLE_NODE_PREFIX.
+ *  @param a: const uint8_t *, First part of the node's contents.
+ *  @param a_len: uint16_t, Length of a in bytes.
+ *  @param b: const uint8_t *, Second part of the node's contents, or NULL.
+ *  @param out: uint8_t *, Buffer of MERKLE_HASH_LEN bytes for the hash.
+ * 
+ *  @return int: 0 on success, nonzero on failure.
+ */
+static int merkle_hash(uint8_t prefix, const uint8_t * a, uint16_t a_len, const uint8_t * b, uint8_t * out) {
+    wc_Sha256 sha;
+    uint8_t digest[WC_SHA256_DIGEST_SIZE];
+
+    if (wc_InitSha256(&sha) != 0) {
+        return -1;
+    }
+    int ret = wc_Sha256Update(&sha, &prefix, sizeof(prefix));
+    ret |= wc_Sha256Update(&sha, a, a_len);
+    if (b != NULL) {
+        ret |= wc_Sha256Update(&sha, b, MERKLE_HASH_LEN);
+    }
+    ret |= wc_Sha256Final(&sha, digest);
+    wc_Sha256Free(&sha);
+
+    memcpy(out, digest, MERKLE_HASH_LEN);
+    return ret;
+}
+
+/** @brief Authenticate a frame by its path to a signed Merkle root.
+ * 
+ *  Costs depth + 1 hashes, in place of a signature verification per frame.
+ * 
+ *  @param leaf: const uint8_t *, Pointer to the frame as it was signed.
+ *  @param leaf_len: uint16_t, Length of the frame in bytes.
+ *  @param index: uint8_t, Position of the frame in its group.
+ *  @param path: const uint8_t *, depth sibling hashes, from the leaf's up.
+ *  @param depth: uint8_t, Number of hashes in path.
+ * 
+ *  @return int: 0 if the path leads to a root in the cache, -1 otherwise.
+ */
+int verify_merkle_path(const uint8_t * leaf, uint16_t leaf_len, uint8_t index,
+                       const uint8_t * path, uint8_t depth) {
+    uint8_t node[MERKLE_HASH_LEN];
+
+    if (depth > MERKLE_MAX_DEPTH || (uint32_t)index >> depth != 0) {
+        return -1;
+    }
+
+    if (merkle_hash(MERKLE_LEAF_PREFIX, leaf, leaf_len, NULL, node) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < depth; i++) {
+        const uint8_t * sibling = &path[i * MERKLE_HASH_LEN];
+        int ret;
+        if ((index >> i) & 1) {
+            ret = merkle_hash(MERKLE_NODE_PREFIX, sibling, MERKLE_HASH_LEN, node, node);
+        } else {
+            ret = merkle_hash(MERKLE_NODE_PREFIX, node, MERKLE_HASH_LEN, sibling, node);
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < ROOT_CACHE_SLOTS; i++) {
+        if (root_valid[i] && memcmp(verified_roots[i], node, MERKLE_HASH_LEN) == 0) {
+            return 0;
+        }
+    }
     return -1;
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 
 from cryptography.hazmat.primitives.ciphers.aead import AESGCM
 from cryptography.hazmat.primitives.asymmetric.ed25519 import Ed25519PrivateKey
+from ectf25_design import kdf_native
 import builtins
 import hashlib
 import os
@@ -18,18 +19,38 @@ KEY_LEN = 16
 NONCE_LEN = 12
 AUTHTAG_LEN = 16
 SIG_LEN = 64
-DEPTH = 64
+TIMESTAMP_BITS = 64
+
+# KDF tree shape, log2 of the number of children per node: 1 is the binary
+# SHA-256 tree, 2 a 4-ary tree where one SHA-512 digest yields all four child
+# keys. gen_secrets records it in the secrets file as kdf_arity_bits, which the
+# Encoder and subscriptions then use, and the Decoder build checks against its
+# KDF_ARITY_BITS (decoder/project.mk)
+ARITY_BITS = int(os.environ.get("ECTF25_KDF_ARITY_BITS", "1"))
+KDF_HASH_ALGS = {1: hashlib.sha256, 2: hashlib.sha512}
+if ARITY_BITS not in KDF_HASH_ALGS:
+    raise ValueError(f"ECTF25_KDF_ARITY_BITS must be one of {list(KDF_HASH_ALGS)}")
+ARITY = 2**ARITY_BITS
+DEPTH = TIMESTAMP_BITS // ARITY_BITS
 
 hash = lambda m: HASH_ALG(m).digest()
 
+# Frames signed as a group carry their path to the group's Merkle root instead of
+# a signature, see verify_merkle_path in decoder/src/verify.c
+MERKLE_HASH_LEN = 16
+MERKLE_MAX_DEPTH = 8
+MERKLE_LEAF_PREFIX = b"\x00"
+MERKLE_NODE_PREFIX = b"\x01"
 
-def split_hash(message):
-    digest = hash(message)
-    return digest[:KEY_LEN], digest[KEY_LEN : 2 * KEY_LEN]
 
-
-left_hash = lambda m: split_hash(m)[0] if m is not None else None
-right_hash = lambda m: split_hash(m)[1] if m is not None else None
+def child_keys(key, arity_bits=ARITY_BITS):
+    """
+    Returns the keys of all children of the node keyed with `key`, left to right.
+    """
+    if key is None:
+        return [None] * 2**arity_bits
+    digest = KDF_HASH_ALGS[arity_bits](key).digest()
+    return [digest[i : i + KEY_LEN] for i in range(0, len(digest), KEY_LEN)]
 
 
 def random_bytes(n):
@@ -52,18 +73,37 @@ def get_nonce() -> bytes:
     return random_bytes(NONCE_LEN)
 
 
+def frame_nonce(channel: int, timestamp: int) -> bytes:
+    """
+    Nonce of a compact frame, which isn't sent: the frame's channel and timestamp.
+    Each (channel, timestamp) has its own frame key, so the pair never repeats
+    under one key as long as a timestamp is never encoded twice for a channel.
+    """
+    return struct.pack("<IQ", channel, timestamp)
+
+
 class Secrets:
-    __slots__ = ("channels", "channel_keys", "shared_key_root", "signing_key")
+    __slots__ = (
+        "channels",
+        "channel_keys",
+        "shared_key_root",
+        "signing_key",
+        "arity_bits",
+    )
     channels: list
     channel_keys: dict[str, bytes]
     shared_key_root: bytes
     signing_key: bytes
+    arity_bits: int
 
-    def __init__(self, channels, channel_keys, shared_key_root, signing_key):
+    def __init__(
+        self, channels, channel_keys, shared_key_root, signing_key, arity_bits=1
+    ):
         self.channels = channels
         self.channel_keys = channel_keys
         self.shared_key_root = shared_key_root
         self.signing_key = signing_key
+        self.arity_bits = arity_bits
 
     @classmethod
     def parse(cls, data):
@@ -72,18 +112,26 @@ class Secrets:
         channel_keys = {int(k): bytes.fromhex(v) for k, v in data["root_keys"].items()}
         shared_key_root = bytes.fromhex(data["shared_key_root"])
         signing_key = bytes.fromhex(data["signing_key"])
+        # Secrets from before the tree shape was recorded are for the binary tree
+        arity_bits = data.get("kdf_arity_bits", 1)
+        if arity_bits not in KDF_HASH_ALGS:
+            raise ValueError(f"kdf_arity_bits must be one of {list(KDF_HASH_ALGS)}")
         return cls(
             channels=channels,
             channel_keys=channel_keys,
             shared_key_root=shared_key_root,
             signing_key=signing_key,
+            arity_bits=arity_bits,
         )
 
     def root_key(self, channel_id):
         return self.channel_keys[channel_id]
 
     def get_tree(self, channel_id):
-        return Tree(root_key=self.root_key(channel_id))
+        return Tree(root_key=self.root_key(channel_id), arity_bits=self.arity_bits)
+
+    def get_key_path(self, channel_id):
+        return KeyPath(root_key=self.root_key(channel_id), arity_bits=self.arity_bits)
 
 
 def encrypt(key, nonce, data, aad):
@@ -93,54 +141,178 @@ def encrypt(key, nonce, data, aad):
     return ciphertext, tag
 
 
+def load_signing_key(key):
+    """
+    Build the signing key object once, for callers that sign many messages.
+    """
+    return Ed25519PrivateKey.from_private_bytes(key)
+
+
 def sign(key, data):
-    priv_key = Ed25519PrivateKey.from_private_bytes(key)
+    priv_key = key if isinstance(key, Ed25519PrivateKey) else load_signing_key(key)
     signature = priv_key.sign(data)
     return signature
 
 
+def merkle_leaf(data):
+    return hash(MERKLE_LEAF_PREFIX + data)[:MERKLE_HASH_LEN]
+
+
+def merkle_node(left, right):
+    return hash(MERKLE_NODE_PREFIX + left + right)[:MERKLE_HASH_LEN]
+
+
+def merkle_tree(leaves):
+    """
+    Returns the levels of the Merkle tree over `leaves`, from the leaf hashes up
+    to [root]. The leaves are padded to a power of two with empty leaves, which
+    no frame can hash to.
+    """
+    depth = (len(leaves) - 1).bit_length()
+    if not leaves or depth > MERKLE_MAX_DEPTH:
+        raise ValueError(f"Can't build a Merkle tree over {len(leaves)} leaves")
+    level = [merkle_leaf(leaf) for leaf in leaves]
+    level += [merkle_leaf(b"")] * (2**depth - len(level))
+    levels = [level]
+    while len(level) > 1:
+        level = [merkle_node(level[i], level[i + 1]) for i in range(0, len(level), 2)]
+        levels.append(level)
+    return levels
+
+
+def merkle_path(levels, index):
+    """
+    Returns the sibling hashes from leaf `index` up to the root, concatenated.
+    """
+    return b"".join(level[(index >> i) ^ 1] for i, level in enumerate(levels[:-1]))
+
+
+def merkle_root(leaf, index, path):
+    node = merkle_leaf(leaf)
+    for i in range(0, len(path), MERKLE_HASH_LEN):
+        sibling = path[i : i + MERKLE_HASH_LEN]
+        if (index >> (i // MERKLE_HASH_LEN)) & 1:
+            node = merkle_node(sibling, node)
+        else:
+            node = merkle_node(node, sibling)
+    return node
+
+
+class KeyPath:
+    """
+    Derives frame keys from a channel's root key, remembering the last
+    root-to-leaf path so that consecutive timestamps only rehash the levels
+    below where their paths split (the host side of the Decoder's kdf_cache_t).
+    """
+
+    def __init__(self, root_key, depth=None, arity_bits=ARITY_BITS):
+        self.arity_bits = arity_bits
+        self.depth = TIMESTAMP_BITS // arity_bits if depth is None else depth
+        # path[l] is the key of the level l node on the way to self.timestamp
+        self.path = [root_key] + [None] * self.depth
+        self.timestamp = None
+
+    def frame_key(self, timestamp):
+        """
+        Find the frame key associated with a given timestamp.
+        """
+        bits = self.arity_bits
+        if not 0 <= timestamp < 1 << (bits * self.depth):
+            return None
+
+        level = 0
+        if self.timestamp is not None:
+            # Levels above the first differing digit are shared with the last path
+            diff_bits = (timestamp ^ self.timestamp).bit_length()
+            level = self.depth - (diff_bits + bits - 1) // bits
+            if level == self.depth:
+                return self.path[level]
+
+        path, kdf_hash = self.path, KDF_HASH_ALGS[bits]
+        mask = 2**bits - 1
+        for level in range(level, self.depth):
+            digest = kdf_hash(path[level]).digest()
+            child = (timestamp >> (bits * (self.depth - 1 - level))) & mask
+            path[level + 1] = digest[child * KEY_LEN : (child + 1) * KEY_LEN]
+
+        self.timestamp = timestamp
+        return path[self.depth]
+
+
 class Tree:
     """
     Tree stores a collection of Nodes to generate key material.
     """
 
-    def __init__(self, make_root=True, root_key=None, depth=DEPTH):
+    def __init__(
+        self, make_root=True, root_key=None, depth=None, arity_bits=ARITY_BITS
+    ):
         """
         :param make_root: whether to generate the root Node or not.
         :param root_key: optional key material for the root_key
-        :param depth: depth of the tree, i.e. #bits in timestamp
+        :param depth: depth of the tree, i.e. #digits in timestamp (default:
+            #bits in timestamp / arity_bits)
+        :param arity_bits: log2 of the number of children per node
         """
         self.nodes = []
-        self.depth = depth
+        self.arity_bits = arity_bits
+        self.depth = TIMESTAMP_BITS // arity_bits if depth is None else depth
 
         if make_root:
             root_key = gen_root_key() if root_key is None else root_key
-            self.add(Node(0, 0, root_key))
+            self.add(self.node(0, 0, root_key))
+
+    def node(self, level, index, key=None):
+        """
+        Returns a Node with this tree's shape.
+        """
+        return Node(level, index, key, depth=self.depth, arity_bits=self.arity_bits)
+
+    def empty(self):
+        """
+        Returns a Tree with this tree's shape and no nodes.
+        """
+        return Tree(make_root=False, depth=self.depth, arity_bits=self.arity_bits)
 
     def add(self, node):
         self.nodes.append(node)
 
-    def get_node(self, level, index):
+    def get_node(self, level, index, native=True):
         """
         Find the node at the given position (level, index).
 
+        Derivation is offloaded to the Decoder's C implementation when it is
+        built for the same tree shape (see kdf_native), unless `native` is False.
+
         Returns None if the node cannot be found in this tree.
         """
+        native = (
+            native
+            and kdf_native.derive_node_key is not None
+            and kdf_native.arity_bits == self.arity_bits
+            and self.depth * self.arity_bits == TIMESTAMP_BITS
+        )
+        mask = 2**self.arity_bits - 1
         for node in self.nodes:
             if node.contains(level, index):
+                if native:
+                    key = kdf_native.derive_node_key(
+                        node.level, node.index, node.key, level, index
+                    )
+                    return self.node(level, index, key)
                 while node.level != level:
-                    left, right = node.left(), node.right()
-                    node = left if left.contains(level, index) else right
+                    shift = self.arity_bits * (level - node.level - 1)
+                    node = node.child((index >> shift) & mask)
                 return node
         return None
 
-    def frame_key(self, timestamp):
+    def frame_key(self, timestamp, native=True):
         """
         Find the frame key associated with a given timestamp.
 
         Returns None if nodes in tree cannot generate the given timestamp.
         """
-        node = self.get_node(self.depth, timestamp)
+        node = self.get_node(self.depth, timestamp, native)
         return node.key if node is not None else None
 
     def minimal_positions(self, start, end):
@@ -152,7 +324,7 @@ class Tree:
             """
             Returns un-keyed nodes covering [start, end].
             """
-            n = Node(self.depth, start, depth=self.depth)
+            n = self.node(self.depth, start)
 
             if start == end:
                 return [n]
@@ -169,15 +341,15 @@ class Tree:
 
         return [(n.level, n.index) for n in helper(start, end)]
 
-    def minimal_tree(self, start, end):
+    def minimal_tree(self, start, end, native=True):
         """
         Return a new Tree containing minimal set of nodes to cover [start, end].
 
         NOTE: Assumes self has the root node.
         """
-        tree = Tree(make_root=False)
+        tree = self.empty()
         for level, index in self.minimal_positions(start, end):
-            tree.add(self.get_node(level, index))
+            tree.add(self.get_node(level, index, native))
 
         assert tree.range() == (start, end)
 
@@ -192,7 +364,7 @@ class Tree:
 
         NOTE: Assumes self has the root node.
         """
-        tree = Tree(make_root=False)
+        tree = self.empty()
 
         while tree.range() != (start, end):
             # Either start at start, or the end of the current tree coverage
@@ -201,17 +373,16 @@ class Tree:
             # Find the first node where start == curr_start
             node = self.get_node(0, 0)
             while node.start() != curr_start:
-                left, right = node.left(), node.right()
-                if curr_start in left:
-                    node = left
-                elif curr_start in right:
-                    node = right
+                for child in node.children():
+                    if curr_start in child:
+                        node = child
+                        break
                 else:
                     raise Exception("Node does not contain start")
 
             # Descend left until we find a node with an end <= desired end
             while node.end() > end:
-                node = node.left()
+                node = node.child(0)
             tree.add(node)
         return tree
 
@@ -229,12 +400,27 @@ class Tree:
             max(self.nodes, key=lambda x: x.end()).end(),
         )
 
-    def get_subscription(self):
+    def get_subscription(self, compact=False):
         """
         Returns (n_keys, byte_array) suitable for sending to a decoder.
+
+        With compact, only the keys are sent, in the order of
+        minimal_positions(start, end) for the subscription's window, which the
+        Decoder rebuilds the levels and indices from. That saves 9 of every 25
+        bytes, but needs the tree to be that minimal cover.
+
+        :raises ValueError: if compact and the tree isn't the minimal cover
         """
         n_keys = len(self)
         subscription = n_keys.to_bytes()
+        if compact:
+            nodes = sorted(self.nodes, key=lambda x: x.start())
+            if [(n.level, n.index) for n in nodes] != self.minimal_positions(
+                *self.range()
+            ):
+                raise ValueError("Compact subscription needs the minimal cover")
+            return subscription + b"".join(node.key for node in nodes)
+
         for node in self.nodes:
             subscription += struct.pack(
                 f"<BQ{KEY_LEN}s", node.level, node.index, node.key
@@ -242,13 +428,24 @@ class Tree:
         return subscription
 
     @staticmethod
-    def from_subscription(subscription: bytes):
+    def from_subscription(subscription: bytes, arity_bits=ARITY_BITS, window=None):
         """
         Constructs a Tree from the subscription update file.
+
+        :param window: (start, end) of a compact subscription, None for a full one
         """
-        t = Tree(make_root=False)
+        t = Tree(make_root=False, arity_bits=arity_bits)
+        if window is not None:
+            keys = [k for (k,) in struct.iter_unpack(f"{KEY_LEN}s", subscription[1:])]
+            positions = t.minimal_positions(*window)
+            if len(keys) != subscription[0] or len(positions) != len(keys):
+                raise ValueError("Compact subscription doesn't match its window")
+            for (level, index), key in zip(positions, keys):
+                t.add(t.node(level, index, key))
+            return t
+
         for level, index, key in struct.iter_unpack(f"<BQ{KEY_LEN}s", subscription[1:]):
-            t.add(Node(level, index, key))
+            t.add(t.node(level, index, key))
         return t
 
     def __eq__(self, other):
@@ -295,11 +492,12 @@ class Node:
     without keys, i.e. for simply navigating upwards.
     """
 
-    def __init__(self, level, index, key=None, depth=DEPTH):
+    def __init__(self, level, index, key=None, depth=None, arity_bits=ARITY_BITS):
         self.level = level
         self.index = index
         self.key = key
-        self.depth = depth
+        self.arity_bits = arity_bits
+        self.depth = TIMESTAMP_BITS // arity_bits if depth is None else depth
 
     def start(self, depth=None):
         """
@@ -308,7 +506,7 @@ class Node:
         When `depth` is None, this returns the earliest timestamp this node can reach.
         """
         depth = self.depth if depth is None else depth
-        return self.index * 2 ** (depth - self.level)
+        return self.index << (self.arity_bits * (depth - self.level))
 
     def end(self, depth=None):
         """
@@ -317,22 +515,43 @@ class Node:
         When `depth` is None, this returns the latest timestamp this node can reach.
         """
         depth = self.depth if depth is None else depth
-        return ((self.index + 1) * 2 ** (depth - self.level)) - 1
+        return ((self.index + 1) << (self.arity_bits * (depth - self.level))) - 1
 
     def range(self, depth=None):
         return (self.start(depth), self.end(depth))
 
+    def children(self):
+        """
+        Returns the nodes obtained by descending in the tree, left to right.
+        """
+        return [
+            Node(
+                self.level + 1,
+                (self.index << self.arity_bits) + i,
+                key,
+                self.depth,
+                self.arity_bits,
+            )
+            for i, key in enumerate(child_keys(self.key, self.arity_bits))
+        ]
+
+    def child(self, i):
+        """
+        Returns the node obtained by descending into the i-th child.
+        """
+        return self.children()[i]
+
     def left(self):
         """
         Returns the node obtained by descending left in the tree.
         """
-        return Node(self.level + 1, self.index * 2, left_hash(self.key))
+        return self.child(0)
 
     def right(self):
         """
         Returns the node obtained by descending right in the tree.
         """
-        return Node(self.level + 1, self.index * 2 + 1, right_hash(self.key))
+        return self.child(-1)
 
     def upper(self):
         """
@@ -340,7 +559,13 @@ class Node:
 
         NOTE: above node is unkeyed, as we can't derive keys of nodes above us.
         """
-        return Node(self.level - 1, self.index // 2, None)
+        return Node(
+            self.level - 1,
+            self.index >> self.arity_bits,
+            None,
+            self.depth,
+            self.arity_bits,
+        )
 
     def contains(self, level, index):
         """
@@ -360,10 +585,13 @@ class Node:
             and self.index == other.index
             and self.key == other.key
             and self.depth == other.depth
+            and self.arity_bits == other.arity_bits
         )
 
     def __hash__(self):
-        return builtins.hash((self.level, self.index, self.key, self.depth))
+        return builtins.hash(
+            (self.level, self.index, self.key, self.depth, self.arity_bits)
+        )
 
     def __repr__(self):
         return f"Node({self.level}, {self.index}, 0x{self.key.hex()})"
@@ -373,7 +601,7 @@ def bench(n=1000):
     total = 0
     for _ in range(n):
         t = Tree()
-        ts = random.randint(0, 2**DEPTH - 1)
+        ts = random.randint(0, 2**TIMESTAMP_BITS - 1)
         start = time.time()
         t.frame_key(ts)
         end = time.time()
@@ -387,8 +615,8 @@ def test_same_frame_keys(N=100):
         if N > 100 and n % 100 == 0:
             print(f"  iter {n}")
         t = Tree()  # Generate a tree with a random root key.
-        start = random.randint(0, 2**DEPTH - 1)
-        end = random.randint(start, 2**DEPTH - 1)
+        start = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        end = random.randint(start, 2**TIMESTAMP_BITS - 1)
         mt = t.minimal_tree(start, end)  # Generate a tree covering only [start, end]
         amt = t._alt_minimal_tree(start, end)
         for n in range(N):
@@ -404,14 +632,28 @@ def test_subscription(N=1000):
         if N > 1000 and n % 1000 == 0:
             print(f"  iter {n}")
         t = Tree()
-        start = random.randint(0, 2**DEPTH - 1)
-        end = random.randint(start, 2**DEPTH - 1)
+        start = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        end = random.randint(start, 2**TIMESTAMP_BITS - 1)
         mt = t.minimal_tree(start, end)
         amt = t._alt_minimal_tree(start, end)
         omt = Tree.from_subscription(mt.get_subscription())
         assert mt == omt
         oatm = Tree.from_subscription(amt.get_subscription())
         assert amt == oatm
+        compact = mt.get_subscription(compact=True)
+        assert len(compact) == 1 + KEY_LEN * len(mt)
+        assert Tree.from_subscription(compact, window=(start, end)) == mt
+
+    # Sibling leaves cover (0, 1), but their parent is the minimal cover
+    t = Tree().minimal_tree(0, 0)
+    for node in Tree().minimal_tree(1, 1).nodes:
+        t.add(node)
+    try:
+        t.get_subscription(compact=True)
+    except ValueError:
+        pass
+    else:
+        assert False, "non-minimal tree sent as a compact subscription"
 
 
 def test_minimal_tree(N=1000):
@@ -420,8 +662,8 @@ def test_minimal_tree(N=1000):
         if N > 1000 and n % 1000 == 0:
             print(f"  iter {n}")
         t = Tree()
-        start = random.randint(0, 2**DEPTH - 1)
-        end = random.randint(start, 2**DEPTH - 1)
+        start = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        end = random.randint(start, 2**TIMESTAMP_BITS - 1)
         mt = t.minimal_tree(start, end)
         amt = t._alt_minimal_tree(start, end)
         assert mt == amt
@@ -435,8 +677,97 @@ def test_minimal_tree(N=1000):
         assert amt.frame_key(end + 1) is None
 
 
+def test_key_path(N=1000):
+    print(f"running test_key_path({N})")
+    t = Tree()
+    path = KeyPath(t.get_node(0, 0).key)
+    ts = random.randint(0, 2**TIMESTAMP_BITS - 1)
+    for n in range(N):
+        # Mostly consecutive timestamps, with the odd jump anywhere in the tree
+        if n % 10 == 0:
+            ts = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        else:
+            ts = min(ts + random.randint(1, 1000), 2**TIMESTAMP_BITS - 1)
+        assert path.frame_key(ts) == t.frame_key(ts)
+        assert path.frame_key(ts) == t.frame_key(ts)
+    assert path.frame_key(2**TIMESTAMP_BITS) is None
+
+
+def test_arity(N=100):
+    """
+    Both tree shapes, whichever one ECTF25_KDF_ARITY_BITS selects.
+    """
+    print(f"running test_arity({N})")
+    for arity_bits in KDF_HASH_ALGS:
+        arity = 2**arity_bits
+        t = Tree(arity_bits=arity_bits)
+        # [1, 2^64 - 2] needs the most nodes, see SUBSCRIPTION_MAX_NODES
+        worst = t.minimal_positions(1, 2**TIMESTAMP_BITS - 2)
+        assert len(worst) == 2 * (arity - 1) * (t.depth - 1) + arity - 2
+        assert t.minimal_positions(0, 2**TIMESTAMP_BITS - 1) == [(0, 0)]
+
+        path = KeyPath(t.get_node(0, 0).key, arity_bits=arity_bits)
+        for n in range(N):
+            start = random.randint(0, 2**TIMESTAMP_BITS - 1)
+            end = random.randint(start, 2**TIMESTAMP_BITS - 1)
+            mt = t.minimal_tree(start, end)
+            assert mt == t._alt_minimal_tree(start, end)
+            omt = Tree.from_subscription(mt.get_subscription(), arity_bits)
+            assert mt == omt
+            for ts in (start, end, random.randint(start, end)):
+                assert mt.frame_key(ts) == t.frame_key(ts) == path.frame_key(ts)
+            assert mt.frame_key(start - 1) is None
+            assert mt.frame_key(end + 1) is None
+
+
+def test_merkle(N=100):
+    for _ in range(N):
+        n = random.randint(1, 40)
+        leaves = [random_bytes(random.randint(1, 64)) for _ in range(n)]
+        levels = merkle_tree(leaves)
+        root = levels[-1][0]
+        for i, leaf in enumerate(leaves):
+            path = merkle_path(levels, i)
+            assert len(path) == MERKLE_HASH_LEN * (len(levels) - 1)
+            assert merkle_root(leaf, i, path) == root
+            assert merkle_root(leaf + b"\x00", i, path) != root
+            if len(leaves) > 1:
+                assert merkle_root(leaf, i ^ 1, path) != root
+
+
+def test_native_kdf(N=1000):
+    """
+    Differential test of the C derivation against the pure python one.
+    """
+    print(f"running test_native_kdf({N})")
+    if kdf_native.derive_node_key is None:
+        print("  skipped, build decoder/cryptosystem with `make lib` first")
+        return
+    if kdf_native.arity_bits != ARITY_BITS:
+        print(f"  skipped, library was built with KDF_ARITY_BITS={kdf_native.arity_bits}")
+        return
+    for n in range(N):
+        if N > 1000 and n % 1000 == 0:
+            print(f"  iter {n}")
+        t = Tree()
+        r = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        assert t.frame_key(r) == t.frame_key(r, native=False)
+        start = random.randint(0, 2**TIMESTAMP_BITS - 1)
+        end = random.randint(start, 2**TIMESTAMP_BITS - 1)
+        mt = t.minimal_tree(start, end)
+        assert mt == t.minimal_tree(start, end, native=False)
+        for ts in (start, end, random.randint(start, end)):
+            assert mt.frame_key(ts) == mt.frame_key(ts, native=False)
+        assert mt.frame_key(start - 1) is None
+        assert mt.frame_key(end + 1) is None
+
+
 if __name__ == "__main__":
     test_same_frame_keys()
     test_subscription()
     test_minimal_tree()
+    test_key_path()
+    test_arity()
+    test_merkle()
+    test_native_kdf()
     pass
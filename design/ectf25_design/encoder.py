@@ -16,6 +16,15 @@ import struct
 import json
 import time
 
+# Decoder packet body size, see BODY_LEN in decoder/inc/messaging.h
+BODY_LEN = 4096
+MAX_FRAME_LEN = 64
+# Channel, timestamp, nonce, frame length, tag (enc_batch_frame_t in decoder/inc/decrypt.h)
+BATCH_FRAME_OVERHEAD = 4 + 8 + cryptosystem.NONCE_LEN + 1 + cryptosystem.AUTHTAG_LEN
+MAX_BATCH_FRAMES = (BODY_LEN - 1 - cryptosystem.SIG_LEN) // (
+    BATCH_FRAME_OVERHEAD + MAX_FRAME_LEN
+)
+
 
 class Encoder:
     def __init__(self, secrets: bytes):
@@ -26,6 +35,23 @@ class Encoder:
             ectf25_design.gen_secrets
         """
         self.secrets = cryptosystem.Secrets.parse(secrets)
+        self.signing_key = cryptosystem.load_signing_key(self.secrets.signing_key)
+        # Long-lived per-channel key paths, so consecutive frames share derivations
+        self.key_paths = {}
+        # Last timestamp encode_compact used on each channel
+        self.compact_timestamps = {}
+
+    def frame_key(self, channel: int, timestamp: int) -> bytes:
+        """Derive the frame key for a channel and timestamp
+
+        :param channel: 32b unsigned channel number
+        :param timestamp: 64b timestamp of the frame
+        :returns: The 16 byte frame key
+        """
+        key_path = self.key_paths.get(channel)
+        if key_path is None:
+            key_path = self.key_paths[channel] = self.secrets.get_key_path(channel)
+        return key_path.frame_key(timestamp)
 
     def encode(self, channel: int, frame: bytes, timestamp: int) -> bytes:
         """The frame encoder function
@@ -45,7 +71,7 @@ class Encoder:
 
         :returns: The encoded frame, which will be sent to the Decoder
         """
-        frame_key = self.secrets.get_tree(channel).frame_key(timestamp)
+        frame_key = self.frame_key(channel, timestamp)
         nonce = cryptosystem.get_nonce()
 
         length = (
@@ -69,10 +95,130 @@ class Encoder:
             + tag
             + encrypted_frame
         )
-        signature = cryptosystem.sign(self.secrets.signing_key, header + body)
+        signature = cryptosystem.sign(self.signing_key, header + body)
+
+        return body + signature
+
+    def encode_compact(self, channel: int, frame: bytes, timestamp: int) -> bytes:
+        """Encode a frame like encode, but without sending its nonce
+
+        The nonce is the frame's channel and timestamp instead, which are unique
+        under the frame key, saving NONCE_LEN bytes per frame and a random draw.
+        Decode it with DecoderIntf.decode_compact. Timestamps must strictly
+        increase per channel, as encoding two frames at the same channel and
+        timestamp would reuse a key and nonce.
+
+        :returns: The encoded frame, which will be sent to the Decoder
+        :raises ValueError: If timestamp isn't past the channel's last compact frame
+        """
+        last = self.compact_timestamps.get(channel)
+        if last is not None and timestamp <= last:
+            raise ValueError(
+                f"Compact frame timestamp {timestamp} on channel {channel} is not"
+                f" after the last one, {last}"
+            )
+
+        frame_key = self.frame_key(channel, timestamp)
+        nonce = cryptosystem.frame_nonce(channel, timestamp)
+
+        length = (
+            4  # Channel
+            + 8  # Timestamp
+            + len(frame)  # Encrypted Frame Data
+            + cryptosystem.AUTHTAG_LEN  # AuthTag
+            + cryptosystem.SIG_LEN  # Signature
+        )
+
+        # Channel and timestamp, which double as the nonce
+        fields = struct.pack("<IQ", channel, timestamp)
+        header = b"%C" + struct.pack("<H", length)
+        encrypted_frame, tag = cryptosystem.encrypt(
+            frame_key, nonce, frame, header + fields
+        )
+
+        body = fields + tag + encrypted_frame
+        signature = cryptosystem.sign(self.signing_key, header + body)
+
+        self.compact_timestamps[channel] = timestamp
+        return body + signature
+
+    def encode_unsigned(self, channel: int, frame: bytes, timestamp: int) -> bytes:
+        """Encrypt one frame for a batch or a signed group, which carry no
+        signature of their own (enc_batch_frame_t in decoder/inc/decrypt.h)
+
+        :raises ValueError: If the frame is empty or too long
+        """
+        if not 0 < len(frame) <= MAX_FRAME_LEN:
+            raise ValueError(f"Frame length {len(frame)} not in (0, {MAX_FRAME_LEN}]")
+
+        frame_key = self.frame_key(channel, timestamp)
+        nonce = cryptosystem.get_nonce()
+        aad = struct.pack(
+            f"<IQ{cryptosystem.NONCE_LEN}sB", channel, timestamp, nonce, len(frame)
+        )
+        encrypted_frame, tag = cryptosystem.encrypt(frame_key, nonce, frame, aad)
+        return aad + tag + encrypted_frame
+
+    def encode_batch(self, frames: list[tuple[int, bytes, int]]) -> bytes:
+        """Encode several frames into one batch decode packet
+
+        The whole batch shares one signature, so the Decoder verifies it once
+        instead of once per frame. Decode it with DecoderIntf.decode_batch.
+
+        :param frames: (channel, frame, timestamp) tuples, as passed to encode.
+            Timestamps must strictly increase through the batch for every frame
+            to be decoded.
+
+        :returns: The encoded batch, which will be sent to the Decoder
+        :raises ValueError: If the batch does not fit in one Decoder packet
+        """
+        body = struct.pack("<B", len(frames))
+        for channel, frame, timestamp in frames:
+            body += self.encode_unsigned(channel, frame, timestamp)
+
+        length = len(body) + cryptosystem.SIG_LEN
+        if len(frames) > 255 or length > BODY_LEN:
+            raise ValueError(f"Batch of {len(frames)} frames is too large")
+
+        header = b"%B" + struct.pack("<H", length)
+        signature = cryptosystem.sign(self.signing_key, header + body)
 
         return body + signature
 
+    def encode_group(
+        self, frames: list[tuple[int, bytes, int]]
+    ) -> tuple[bytes, list[bytes]]:
+        """Encode frames to be sent one by one under a single signature
+
+        The signature goes on the group's Merkle root, sent once with
+        DecoderIntf.send_root, and each frame carries its path to the root in
+        place of a signature. Send them with DecoderIntf.decode_path, in order,
+        after the root; frames lost on the way don't affect the others. Paths
+        grow by MERKLE_HASH_LEN bytes each time the group doubles, so groups of
+        up to 8 frames also take fewer bytes than signing every frame.
+
+        :param frames: (channel, frame, timestamp) tuples, as passed to encode.
+            Timestamps must strictly increase through the group for every frame
+            to be decoded.
+
+        :returns: The encoded root and the encoded frames, in group order
+        :raises ValueError: If there are no frames or more than
+            2**MERKLE_MAX_DEPTH of them
+        """
+        leaves = [self.encode_unsigned(*frame) for frame in frames]
+        levels = cryptosystem.merkle_tree(leaves)
+        depth = len(levels) - 1
+
+        root = levels[-1][0]
+        header = b"%R" + struct.pack("<H", len(root) + cryptosystem.SIG_LEN)
+        root += cryptosystem.sign(self.signing_key, header + root)
+
+        encoded = [
+            struct.pack("<BB", i, depth) + cryptosystem.merkle_path(levels, i) + leaf
+            for i, leaf in enumerate(leaves)
+        ]
+        return root, encoded
+
 
 def main(bench_encode=False, bench_decode=False):
     """A test main to one-shot encode a frame
@@ -37,6 +37,8 @@ def gen_secrets(channels: list[int]) -> bytes:
         "root_keys": { channel: cryptosystem.gen_root_key().hex() for channel in channels },
         "shared_key_root": cryptosystem.gen_root_key().hex(),
         "signing_key": cryptosystem.gen_ed25519_key().hex(),
+        # KDF tree shape, which the Decoder build checks its KDF_ARITY_BITS against
+        "kdf_arity_bits": cryptosystem.ARITY_BITS,
     }
 
     return json.dumps(secrets).encode()
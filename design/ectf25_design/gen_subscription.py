@@ -37,7 +37,8 @@ def gen_subscription(
     tree = secrets.get_tree(channel)
 
     subtree = tree.minimal_tree(start, end)
-    subscription = subtree.get_subscription()
+    # Only the keys, the Decoder rebuilds their positions from start and end
+    subscription = subtree.get_subscription(compact=True)
 
     signing_key = secrets.signing_key
 
@@ -0,0 +1,82 @@
+"""
+ctypes bindings to the Decoder's key derivation (decoder/cryptosystem/src/cryptosystem.c),
+built as a host shared library with `make lib` in decoder/cryptosystem/.
+
+The library is looked for at $ECTF25_KDF_LIB, then next to the cryptosystem
+sources in this repository. If it can't be loaded, or predates kdf_arity_bits,
+`derive_node_key` is None and callers fall back to the pure python derivation.
+`arity_bits` is the tree shape the library was built for (its KDF_ARITY_BITS),
+which callers must match.
+"""
+
+import ctypes
+import os
+from pathlib import Path
+
+KEY_LEN = 16
+
+LIB_NAME = "libcryptosystem.so"
+DEFAULT_LIB_PATH = (
+    Path(__file__).resolve().parents[2] / "decoder" / "cryptosystem" / LIB_NAME
+)
+
+
+class KdfNode(ctypes.Structure):
+    """kdf_node_t"""
+
+    _pack_ = 1
+    _fields_ = [
+        ("level", ctypes.c_uint8),
+        ("index", ctypes.c_uint64),
+        ("key", ctypes.c_uint8 * KEY_LEN),
+    ]
+
+
+def load(path=None):
+    """
+    Load the library, returning None if it isn't built or doesn't match.
+    """
+    path = path or os.environ.get("ECTF25_KDF_LIB") or DEFAULT_LIB_PATH
+    try:
+        lib = ctypes.CDLL(str(path))
+    except OSError:
+        return None
+
+    if ctypes.sizeof(KdfNode) != 1 + 8 + KEY_LEN:
+        return None
+
+    lib.derive_node_key.argtypes = [
+        ctypes.POINTER(KdfNode),
+        ctypes.c_uint8,
+        ctypes.c_uint64,
+        ctypes.c_char_p,
+    ]
+    lib.derive_node_key.restype = ctypes.c_int
+    # A library that can't say which tree it derives is stale
+    if not hasattr(lib, "kdf_arity_bits"):
+        return None
+    lib.kdf_arity_bits.argtypes = []
+    lib.kdf_arity_bits.restype = ctypes.c_uint8
+    return lib
+
+
+_lib = load()
+
+
+def _derive_node_key(ancestor_level, ancestor_index, ancestor_key, level, index):
+    """
+    Derive the key of the node at (level, index) from its ancestor's key.
+
+    Returns None if (level, index) isn't below the ancestor.
+    """
+    ancestor = KdfNode(
+        ancestor_level, ancestor_index, (ctypes.c_uint8 * KEY_LEN)(*ancestor_key)
+    )
+    out = ctypes.create_string_buffer(KEY_LEN)
+    if _lib.derive_node_key(ctypes.byref(ancestor), level, index, out) != 0:
+        return None
+    return out.raw
+
+
+derive_node_key = _derive_node_key if _lib is not None else None
+arity_bits = _lib.kdf_arity_bits() if _lib is not None else None
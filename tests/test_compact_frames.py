@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+import argparse
+import sys
+from loguru import logger
+
+import random
+from ectf25.utils.decoder import DecoderIntf, DecoderError, Opcode, Message
+from ectf25_design import cryptosystem
+from ectf25_design.encoder import Encoder
+from ectf25_design.gen_subscription import gen_subscription
+
+logger.remove()
+logger.add(sys.stdout, level="INFO")
+
+
+def expect_error(decoder, opcode, data, what):
+    decoder.send_msg(Message(opcode, data))
+    try:
+        resp = decoder.get_msg()
+    except DecoderError:
+        logger.info(f"Got expected DecoderError for {what}")
+        return
+    raise Exception(f"Decoder accepted {what}, returning {resp}")
+
+
+def expect_success(decoder, encoded, frame, what):
+    try:
+        decoded = decoder.decode_compact(encoded)
+    except DecoderError:
+        raise Exception(f"Decoder unexpectedly raised a DecoderError for {what}")
+    assert decoded == frame, f"Decoded the wrong frame for {what}"
+
+
+def flip(data, i):
+    data = bytearray(data)
+    data[i] ^= 1 << random.randrange(8)
+    return bytes(data)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(prog="ectf25_design.encoder")
+    parser.add_argument(
+        "secrets_file", type=argparse.FileType("rb"), help="Path to the secrets file"
+    )
+    parser.add_argument(
+        "device_id", type=lambda x: int(x, 0), help="Device ID of the update recipient."
+    )
+    parser.add_argument(
+        "--port",
+        default="/dev/ttyACM0",
+        help="Serial port to the Decoder",
+    )
+    parser.add_argument(
+        "-n",
+        "--num-frames",
+        type=int,
+        default=500,
+        help="Number of frames to test",
+    )
+    return parser.parse_args()
+
+
+def main(args):
+    logger.info(f"Starting compact frames test!")
+    secrets_data = args.secrets_file.read()
+    secrets = cryptosystem.Secrets.parse(secrets_data)
+    encoder = Encoder(secrets_data)
+    decoder = DecoderIntf(args.port)
+
+    channel = random.choice(secrets.channels[1:])
+    start = random.randint(0, 2**63)
+    end = start + 2**32
+    decoder.subscribe(
+        gen_subscription(secrets_data, args.device_id, start, end, channel)
+    )
+    timestamp = start
+
+    # Compact frames are NONCE_LEN bytes shorter than regular ones
+    frame = random.randbytes(64)
+    regular = encoder.encode(channel, frame, timestamp)
+    compact = encoder.encode_compact(channel, frame, timestamp)
+    assert len(regular) - len(compact) == cryptosystem.NONCE_LEN
+
+    # The encoder won't reuse a channel and timestamp, its key and nonce
+    try:
+        encoder.encode_compact(channel, random.randbytes(64), timestamp)
+    except ValueError:
+        logger.info("Encoder refused to reuse a compact frame's timestamp")
+    else:
+        raise Exception("Encoder reused a compact frame's timestamp")
+
+    # Neither format passes for the other: the opcode is signed and in the AAD
+    expect_error(decoder, Opcode.DECODE, compact, "a compact frame as a regular one")
+    expect_error(decoder, Opcode.COMPACT, regular, "a regular frame as a compact one")
+
+    # Compact frames, with tampered, stale and regular frames mixed in
+    logger.info(f"Testing {args.num_frames} compact frames")
+    for n in range(args.num_frames):
+        timestamp += random.randint(1, 1000)
+        frame = random.randbytes(random.randint(1, 64))
+        r = random.random()
+        if r < 0.2:
+            enc = encoder.encode_compact(channel, frame, timestamp)
+            tampered = flip(enc, random.randrange(len(enc)))
+            expect_error(decoder, Opcode.COMPACT, tampered, "a tampered frame")
+        elif r < 0.3:
+            enc = encoder.encode(channel, frame, timestamp)
+            assert decoder.decode(enc) == frame, f"Decoded the wrong frame {n}"
+            continue
+        else:
+            enc = encoder.encode_compact(channel, frame, timestamp)
+
+        expect_success(decoder, enc, frame, f"frame {n}")
+        expect_error(decoder, Opcode.COMPACT, enc, "a replayed frame")
+
+    # Outside the subscription
+    enc = encoder.encode_compact(channel, b"late", end + 1)
+    expect_error(decoder, Opcode.COMPACT, enc, "a frame past the subscription")
+
+    logger.info("Compact frames test passed yippee!")
+
+
+if __name__ == "__main__":
+    args = parse_args()
+    main(args)
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+
+import argparse
+import sys
+from loguru import logger
+
+import random
+from ectf25.utils.decoder import DecoderIntf, DecoderError, Opcode, Message
+from ectf25_design import cryptosystem
+from ectf25_design.encoder import Encoder
+from ectf25_design.gen_subscription import gen_subscription
+
+logger.remove()
+logger.add(sys.stdout, level="INFO")
+
+# ROOT_CACHE_SLOTS in decoder/inc/verify.h
+ROOT_CACHE_SLOTS = 4
+
+
+def make_group(encoder, channel, timestamp, size):
+    frames = [
+        (channel, random.randbytes(random.randint(1, 64)), timestamp + i)
+        for i in range(size)
+    ]
+    root, encoded = encoder.encode_group(frames)
+    return [frame for _, frame, _ in frames], root, encoded
+
+
+def expect_error(decoder, opcode, data, what):
+    decoder.send_msg(Message(opcode, data))
+    try:
+        resp = decoder.get_msg()
+    except DecoderError:
+        logger.info(f"Got expected DecoderError for {what}")
+        return
+    raise Exception(f"Decoder accepted {what}, returning {resp}")
+
+
+def expect_success(decoder, encoded, frame, what):
+    try:
+        decoded = decoder.decode_path(encoded)
+    except DecoderError:
+        raise Exception(f"Decoder unexpectedly raised a DecoderError for {what}")
+    assert decoded == frame, f"Decoded the wrong frame for {what}"
+
+
+def flip(data, i):
+    data = bytearray(data)
+    data[i] ^= 1 << random.randrange(8)
+    return bytes(data)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(prog="ectf25_design.encoder")
+    parser.add_argument(
+        "secrets_file", type=argparse.FileType("rb"), help="Path to the secrets file"
+    )
+    parser.add_argument(
+        "device_id", type=lambda x: int(x, 0), help="Device ID of the update recipient."
+    )
+    parser.add_argument(
+        "--port",
+        default="/dev/ttyACM0",
+        help="Serial port to the Decoder",
+    )
+    parser.add_argument(
+        "-n",
+        "--num-groups",
+        type=int,
+        default=50,
+        help="Number of groups of frames to test",
+    )
+    return parser.parse_args()
+
+
+def main(args):
+    logger.info(f"Starting signed groups test!")
+    secrets_data = args.secrets_file.read()
+    secrets = cryptosystem.Secrets.parse(secrets_data)
+    encoder = Encoder(secrets_data)
+    decoder = DecoderIntf(args.port)
+
+    channel = random.choice(secrets.channels[1:])
+    start = random.randint(0, 2**63)
+    end = start + 2**32
+    decoder.subscribe(
+        gen_subscription(secrets_data, args.device_id, start, end, channel)
+    )
+    timestamp = start
+
+    # A root with a bad signature isn't cached, so its frames don't decode
+    logger.info("Testing forged roots")
+    frames, root, encoded = make_group(encoder, channel, timestamp, 8)
+    forged = flip(root, random.randrange(len(root)))
+    expect_error(decoder, Opcode.ROOT, forged, "a forged root")
+    expect_error(decoder, Opcode.ROOT, root[:-1], "a truncated root")
+    expect_error(decoder, Opcode.PATH, encoded[0], "a frame without its root")
+
+    # Valid groups, with tampered, reordered and replayed frames mixed in
+    logger.info("Testing groups of frames")
+    for n in range(args.num_groups):
+        size = random.randint(1, 16)
+        frames, root, encoded = make_group(encoder, channel, timestamp, size)
+        timestamp += size
+        decoder.send_root(root)
+
+        decoded = None
+        for i, (frame, enc) in enumerate(zip(frames, encoded)):
+            r = random.random()
+            if r < 0.2:
+                tampered = flip(enc, random.randrange(len(enc)))
+                expect_error(decoder, Opcode.PATH, tampered, "a tampered frame")
+            elif r < 0.3 and size > 1:
+                # A frame claiming another position than the one it was signed at
+                moved = bytes([(enc[0] + 1) % size]) + enc[1:]
+                expect_error(decoder, Opcode.PATH, moved, "a frame at the wrong index")
+            elif r < 0.4:
+                # Frames lost on the way don't stop the rest of the group decoding
+                continue
+            expect_success(decoder, enc, frame, f"frame {i} of group {n}")
+            decoded = enc
+
+            # The same frame again, or an earlier one, is a replay
+            expect_error(decoder, Opcode.PATH, enc, "a replayed frame")
+            earlier = encoded[random.randint(0, i)]
+            expect_error(decoder, Opcode.PATH, earlier, "an earlier frame")
+
+        # Replaying the root doesn't bring the group's frames back
+        if decoded is not None:
+            decoder.send_root(root)
+            expect_error(decoder, Opcode.PATH, decoded, "a replay after its root")
+
+    # Groups can be interleaved, up to the number of roots the Decoder remembers
+    logger.info("Testing root cache eviction")
+    groups = []
+    for _ in range(ROOT_CACHE_SLOTS + 1):
+        groups.append(make_group(encoder, channel, timestamp, 4))
+        decoder.send_root(groups[-1][1])
+        timestamp += 4
+    expect_error(decoder, Opcode.PATH, groups[0][2][0], "a frame of an evicted root")
+    for frames, _, encoded in groups[1:]:
+        expect_success(decoder, encoded[0], frames[0], "a frame of a cached root")
+
+    logger.info("Signed groups test passed yippee!")
+
+
+if __name__ == "__main__":
+    args = parse_args()
+    main(args)
@@ -12,33 +12,139 @@ Copyright: Copyright (c) 2025 The MITRE Corporation
 
 import argparse
 import asyncio
-from asyncio import StreamWriter, StreamReader, Future, TaskGroup, Lock
+from asyncio import StreamWriter, StreamReader, TaskGroup, Lock
+from collections import deque
 from dataclasses import dataclass
+from enum import Enum
 import json
+import time
+from typing import Callable
 
 from loguru import logger
 
+from ectf25.utils import framing
+
+
+class Policy(Enum):
+    """What a Subscriber does with a message published while its queue is full"""
+
+    DROP_OLDEST = "drop-oldest"
+    DROP_NEWEST = "drop-newest"
+    DISCONNECT = "disconnect"
+
+
+class Subscriber:
+    """Subscriber
+    A bounded queue of the messages published to one subscriber that it has
+    yet to consume, so a slow subscriber costs at most maxlen messages. Iterate
+    it for (publish time, message) pairs until it is closed
+    """
+
+    def __init__(
+        self, name: str, maxlen: int, policy: Policy, on_overflow: Callable = None
+    ):
+        """
+        :param name: Name to report stats under
+        :param maxlen: Messages queued before policy applies
+        :param policy: What to do with a message published while the queue is full
+        :param on_overflow: Called when the DISCONNECT policy closes the queue, as
+            the consumer may be blocked elsewhere
+        """
+        self.name = name
+        self.maxlen = maxlen
+        self.policy = policy
+        self.on_overflow = on_overflow
+        self.queue: deque[tuple[float, bytes]] = deque()
+        self.ready = asyncio.Event()
+        self.closed = False
+        self.overflowed = False
+
+        self.sent = 0
+        self.drops = 0
+        self.max_depth = 0
+        # Publish to sent latencies since the last stats(reset=True)
+        self.latency_count = 0
+        self.latency_total = 0.0
+        self.latency_max = 0.0
+
+    def put(self, value: bytes):
+        if len(self.queue) >= self.maxlen:
+            if self.policy == Policy.DISCONNECT:
+                self.overflowed = True
+                self.close()
+                if self.on_overflow:
+                    self.on_overflow()
+                return
+            self.drops += 1
+            if self.policy == Policy.DROP_NEWEST:
+                return
+            if self.queue:
+                self.queue.popleft()
+        self.queue.append((time.monotonic(), value))
+        self.max_depth = max(self.max_depth, len(self.queue))
+        self.ready.set()
+
+    def close(self):
+        self.closed = True
+        self.queue.clear()
+        self.ready.set()
+
+    def done(self, published: float):
+        """Record that the message published at published has been sent"""
+        latency = time.monotonic() - published
+        self.sent += 1
+        self.latency_count += 1
+        self.latency_total += latency
+        self.latency_max = max(self.latency_max, latency)
+
+    def stats(self, reset: bool = False) -> dict:
+        """Queue depth, drops and send latency (in ms, since the last reset)"""
+        count = self.latency_count
+        stats = {
+            "name": self.name,
+            "depth": len(self.queue),
+            "max_depth": self.max_depth,
+            "sent": self.sent,
+            "drops": self.drops,
+            "latency_ms": 1000 * self.latency_total / count if count else 0.0,
+            "max_latency_ms": 1000 * self.latency_max,
+        }
+        if reset:
+            self.latency_count = 0
+            self.latency_total = self.latency_max = 0.0
+        return stats
+
+    async def __aiter__(self):
+        while True:
+            while not self.queue and not self.closed:
+                self.ready.clear()
+                await self.ready.wait()
+            if self.closed:
+                return
+            yield self.queue.popleft()
+
 
 class PubSub:
     """PubSub
     Publisher-Subscriber class. A call to publish will broadcast the message
-    to all subscribers awaiting on subscribe
+    to all subscribers, queueing it for each one (see Subscriber)
     """
 
     def __init__(self):
-        self.waiter = Future()
+        self.subscribers: set[Subscriber] = set()
 
-    def publish(self, value):
-        waiter, self.waiter = self.waiter, Future()
-        waiter.set_result((value, self.waiter))
+    def publish(self, value: bytes):
+        for subscriber in self.subscribers:
+            subscriber.put(value)
 
-    async def subscribe(self):
-        waiter = self.waiter
-        while True:
-            value, waiter = await waiter
-            yield value
+    def subscribe(self, *args, **kwargs) -> Subscriber:
+        subscriber = Subscriber(*args, **kwargs)
+        self.subscribers.add(subscriber)
+        return subscriber
 
-    __aiter__ = subscribe
+    def unsubscribe(self, subscriber: Subscriber):
+        self.subscribers.discard(subscriber)
+        subscriber.close()
 
 
 @dataclass
@@ -63,12 +169,22 @@ class Satellite:
         channels: dict[int, Channel],
         up_host: str,
         up_port: int,
+        queue_len: int = 64,
+        policy: Policy = Policy.DROP_OLDEST,
+        stats_interval: float = 0,
     ):
         """
         :param channels: List of channels to serve on
         :param up_host: Hostname for uplink
         :param up_port: Port for uplink
+        :param queue_len: Frames queued per downlink before policy applies
+        :param policy: What to do with frames for a downlink with a full queue
+        :param stats_interval: Seconds between logging each downlink's stats (0 to
+            never log them)
+        :raises ValueError: queue_len is less than 1
         """
+        if queue_len < 1:
+            raise ValueError(f"Queue length must be at least 1, not {queue_len}")
         self.channels = channels
         self.port_to_channels = {
             channel.down_port: channel for channel in self.channels.values()
@@ -78,31 +194,71 @@ class Satellite:
         self.cleanup_tasks: list[asyncio.Task] = []
         self.streams: set[asyncio.StreamWriter] = set()
         self.encoder_lock = Lock()
+        self.queue_len = queue_len
+        self.policy = policy
+        self.stats_interval = stats_interval
+        self.subscribers: set[Subscriber] = set()
 
     async def downlink(self, _, writer: StreamWriter):
         """Handles the downlink for one TV on one channel"""
         self.streams.add(writer)
         port = writer.transport.get_extra_info("sockname")[1]
         peer = writer.transport.get_extra_info("peername")
+        channel = self.port_to_channels[port]
+        subscriber = channel.pubsub.subscribe(
+            f"{peer[0]}:{peer[1]}@{channel.number}",
+            self.queue_len,
+            self.policy,
+            # Drop whatever it hasn't taken yet, which also wakes up drain()
+            writer.transport.abort,
+        )
+        self.subscribers.add(subscriber)
         try:
-            channel = self.port_to_channels[port]
             logger.info(f"{peer} Downlink opened on channel {channel.number}")
-            async for message in channel.pubsub:
+            async for published, message in subscriber:
                 writer.write(message)
                 await writer.drain()
+                subscriber.done(published)
         except ConnectionResetError:
             pass
         finally:
-            logger.warning(f"{peer} Downlink closed")
+            if subscriber.overflowed:
+                logger.warning(f"{peer} Downlink too slow, disconnected it")
+            logger.warning(f"{peer} Downlink closed, {self.describe(subscriber)}")
+            channel.pubsub.unsubscribe(subscriber)
+            self.subscribers.discard(subscriber)
             self.streams.discard(writer)
 
+    def stats(self, reset: bool = False) -> list[dict]:
+        """Each open downlink's stats (see Subscriber.stats)"""
+        return [s.stats(reset) for s in sorted(self.subscribers, key=lambda s: s.name)]
+
+    def describe(self, subscriber: Subscriber, reset: bool = False) -> str:
+        stats = subscriber.stats(reset)
+        return (
+            f"{stats['name']} depth {stats['depth']}/{self.queue_len}"
+            f" (max {stats['max_depth']}), sent {stats['sent']},"
+            f" dropped {stats['drops']}, latency {stats['latency_ms']:.1f}ms"
+            f" (max {stats['max_latency_ms']:.1f}ms)"
+        )
+
+    async def report_stats(self):
+        """Log each downlink's stats every stats_interval seconds"""
+        while True:
+            await asyncio.sleep(self.stats_interval)
+            for subscriber in sorted(self.subscribers, key=lambda s: s.name):
+                logger.info(self.describe(subscriber, reset=True))
+
     async def serve_uplink(self, reader: StreamReader, _):
-        """Serve uplink connections"""
+        """Serve uplink connections
+
+        Frames are forwarded in whichever framing they arrived in, routed on
+        the channel alone (see ectf25.utils.framing)
+        """
         try:
             while True:
-                raw_frame = await reader.readline()
-                frame = json.loads(raw_frame.decode())
-                channel = frame["channel"]
+                raw_frame = await framing.read_message_async(reader)
+                channel = framing.channel_of(raw_frame)
                 if channel == 0:
                     for c in self.channels.values():
                         c.pubsub.publish(raw_frame)
@@ -113,7 +269,7 @@ class Satellite:
                         f"Bad channel {channel} (expected {list(self.channels)})"
                     )
                 await asyncio.sleep(0)
-        except json.JSONDecodeError:
+        except (json.JSONDecodeError, asyncio.IncompleteReadError):
             logger.critical("Uplink read fail!")
         finally:
             logger.critical("Uplink ended unexpectedly!")
@@ -135,9 +291,11 @@ class Satellite:
             self.handle_fatal()
 
     def handle_fatal(self):
-        """Cleanup tasks and streams on a fatal error"""
+        """Cleanup tasks, queues and streams on a fatal error"""
         for task in self.cleanup_tasks:
             task.cancel()
+        for subscriber in self.subscribers:
+            subscriber.close()
         for stream in self.streams:
             stream.close()
 
@@ -155,6 +313,10 @@ class Satellite:
         logger.info(f"Serving channels {self.channels}")
         async with TaskGroup() as tg:
             tg.create_task(self.serve_uplink(reader, writer), name="uplink")
+            if self.stats_interval:
+                self.cleanup_tasks.append(
+                    tg.create_task(self.report_stats(), name="stats")
+                )
             for number, channel in self.channels.items():
                 tg.create_task(
                     self.serve_downlink(channel),
@@ -172,6 +334,13 @@ def channel_ty(arg: str):
         raise
 
 
+def queue_len_ty(arg: str) -> int:
+    queue_len = int(arg)
+    if queue_len < 1:
+        raise argparse.ArgumentTypeError(f"must be at least 1, not {queue_len}")
+    return queue_len
+
+
 async def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("up_host", help="Hostname for uplink")
@@ -183,12 +352,40 @@ async def main():
         type=channel_ty,
         help="List of channel:down_port pairings (e.g., 1:2001 2:2002)",
     )
+    parser.add_argument(
+        "--queue-len",
+        type=queue_len_ty,
+        default=64,
+        help="Frames queued for each TV before --policy applies",
+    )
+    parser.add_argument(
+        "--policy",
+        type=Policy,
+        default=Policy.DROP_OLDEST,
+        choices=list(Policy),
+        metavar="{" + ",".join(p.value for p in Policy) + "}",
+        help="What to do with frames for a TV too slow to keep up (default:"
+        " drop-oldest)",
+    )
+    parser.add_argument(
+        "--stats-interval",
+        type=float,
+        default=0,
+        help="Seconds between logging each TV's queue stats (0 to never log them)",
+    )
     args = parser.parse_args()
 
     channels = {
         number: Channel(number, args.down_host, port) for number, port in args.channels
     }
-    satellite = Satellite(channels, args.up_host, args.up_port)
+    satellite = Satellite(
+        channels,
+        args.up_host,
+        args.up_port,
+        args.queue_len,
+        args.policy,
+        args.stats_interval,
+    )
     await satellite.serve()
 
     # should only reach here on crash
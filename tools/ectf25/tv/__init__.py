@@ -10,8 +10,6 @@ own risk!
 Copyright: Copyright (c) 2025 The MITRE Corporation
 """
 
-import binascii
-import json
 from queue import Queue
 import socket
 import threading
@@ -19,6 +17,7 @@ import time
 
 from loguru import logger
 
+from ectf25.utils import framing
 from ectf25.utils.decoder import DecoderIntf
 
 
@@ -60,18 +59,16 @@ class TV:
             s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
             s.connect((self.sat_host, self.sat_port))
 
+            stream = s.makefile("rb")
+
             # Get frames forever
             while not self.crash.is_set():
-                # Get and decode frame
-                line = b""
-                while not line.endswith(b"\n"):
-                    if (cur_byte := s.recv(1)) == b"":  # connection closed
-                        raise RuntimeError("Failed to receive from satellite")
-                    line += cur_byte
-                frame = json.loads(line)
-                channel = frame["channel"]
-                timestamp = frame["timestamp"]
-                encoded = binascii.a2b_hex(frame.pop("encoded"))
+                # Get and decode frame, in either framing
+                try:
+                    message = framing.read_message(stream)
+                except EOFError:  # connection closed
+                    raise RuntimeError("Failed to receive from satellite")
+                channel, timestamp, encoded = framing.unpack(message)
                 logger.debug(f"Received encoded ({channel}, {timestamp}): {encoded}")
 
                 # Put frame in decode queue
@@ -112,6 +109,9 @@ class TV:
                     except UnicodeDecodeError:
                         # if we can't decode bytes, fall back to just printing the frame
                         logger.info(decoded)
+                else:
+                    # Release the Decoder to derive keys ahead while we wait
+                    self.decoder.flush()
         except Exception:
             logger.critical("Decoder crashed!")
             self.crash.set()
@@ -10,16 +10,20 @@ own risk!
 Copyright: Copyright (c) 2025 The MITRE Corporation
 """
 
+import argparse
 import asyncio
 from asyncio import Event, Queue, Lock
+from concurrent.futures import ProcessPoolExecutor
 from dataclasses import dataclass
-from collections import namedtuple
+from collections import deque, namedtuple
 import json
+import os
 import time
 
 from loguru import logger
 
 from ectf25.utils import Encoder
+from ectf25.utils import framing
 
 
 Frame = namedtuple("Frame", ["channel", "data", "timestamp"])
@@ -33,18 +37,41 @@ class Channel:
 
     def __post_init__(self):
         self.send_frame = Event()
+        self.start()
+
+    def start(self):
+        """Start the schedule over: frame k is sent k / fps seconds from now"""
+        self.start_us = time.time_ns() // 1000
+        self.start_monotonic = time.monotonic()
+        # Slot of the last send_frame, which the frame with that slot's
+        # timestamp should answer
+        self.slot = 0
+
+    def slot_timestamp(self, k: int) -> int:
+        """Timestamp of frame k, its scheduled send time in microseconds"""
+        return self.start_us + int(k * 1_000_000 / self.fps)
 
     async def frame_clock(self):
-        """Triggers the send_frame Event every time a frame should be sent"""
-        sleep = 1 / self.fps
+        """Triggers the send_frame Event every time a frame should be sent, with
+        self.slot set to the slot it is for
+        """
+        k = 0
         try:
             while True:
-                if self.send_frame.is_set():
+                late = self.send_frame.is_set()
+                self.slot = k
+                self.send_frame.set()
+                # Sleep until the next slot rather than for a period, so the
+                # clock keeps to the timestamps frames are encoded with. Slots
+                # already missed are skipped rather than fired all at once
+                now = time.monotonic()
+                slot = int((now - self.start_monotonic) * self.fps) + 1
+                if late or slot > k + 1:
                     logger.warning(
                         f"Channel {self.number} not meeting FPS requirement!"
                     )
-                self.send_frame.set()
-                await asyncio.sleep(sleep)
+                k = max(k + 1, slot)
+                await asyncio.sleep(self.start_monotonic + k / self.fps - now)
         finally:
             logger.critical(f"{self} frame clock crashed!")
 
@@ -76,9 +103,38 @@ class Channel:
         return cls(int(number), int(fps), frames)
 
 
+def at_least(minimum: int):
+    """An argparse type for integers of at least minimum"""
+
+    def parse(arg: str) -> int:
+        value = int(arg)
+        if value < minimum:
+            raise argparse.ArgumentTypeError(f"must be at least {minimum}, not {value}")
+        return value
+
+    return parse
+
+
 LOW_PRIORITY = 1
 HIGH_PRIORITY = 2
 
+# Each pre-encoding process's Encoder, see Uplink.encode_ahead
+_encoder = None
+
+
+def _init_encoder(secrets: bytes):
+    global _encoder
+    _encoder = Encoder(secrets)
+
+
+def _encode_slots(
+    channel: int, frames: list[tuple[bytes, int]]
+) -> list[tuple[int, bytes]]:
+    return [
+        (timestamp, _encoder.encode(channel, frame, timestamp))
+        for frame, timestamp in frames
+    ]
+
 
 class Uplink:
     """Robust Uplink class to serve encoded frames to the Satellite for the full
@@ -87,15 +143,39 @@ class Uplink:
     You can use ectf25.utils.tester for a lighter-weight development setup
     """
 
-    def __init__(self, secrets: bytes, channels: list[Channel], host: str, port: int):
+    def __init__(
+        self,
+        secrets: bytes,
+        channels: list[Channel],
+        host: str,
+        port: int,
+        binary: bool = False,
+        workers: int | None = None,
+        ahead: int = 16,
+    ):
         """
         :param secrets: Contents of the secrets file generated by
             ectf25_design.gen_secrets
         :param channels: List of Channels to serve
         :param host: TCP host to serve frames on (use localhost for local setup)
         :param port: TCP port to serve frames on
+        :param binary: Send frames in the binary framing instead of JSON lines (see
+            ectf25.utils.framing)
+        :param workers: Processes to encode frames in (None for one per CPU, 0 to
+            encode on the event loop)
+        :param ahead: Frames each channel encodes at a time, ahead of sending them
+            (1 when encoding on the event loop, so as not to block it for longer)
+        :raises ValueError: workers is negative or ahead is less than 1
         """
+        if workers is not None and workers < 0:
+            raise ValueError(f"Workers must be at least 0, not {workers}")
+        if ahead < 1:
+            raise ValueError(f"Frames encoded ahead must be at least 1, not {ahead}")
         self.secrets = secrets
+        self.binary = binary
+        self.workers = os.cpu_count() if workers is None else workers
+        self.ahead = ahead if self.workers else 1
+        self.pool = None
         self.host = host
         self.port = port
         self.channels = channels
@@ -124,9 +204,9 @@ class Uplink:
             while True:
                 async with self.read_lock:
                     frame = await self.encoded_queue.get()
-                writer.write(f"{frame}\n".encode())
+                writer.write(frame)
                 await writer.drain()
-        except (ConnectionResetError, json.JSONDecodeError):
+        except ConnectionResetError:
             # gracefully handle satellite crashing
             pass
         finally:
@@ -145,39 +225,90 @@ class Uplink:
         finally:
             logger.critical("Uplink server ended unexpectedly!")
 
+    def encode_ahead(self, channel: Channel, first: int) -> asyncio.Future:
+        """Encode the next self.ahead frames of channel from frame first, each
+        timestamped with its slot, in the pool
+
+        :returns: A Future of their (timestamp, encoded frame)s, in order
+        """
+        frames = [
+            (
+                channel.frames[k % len(channel.frames)].data.encode(),
+                channel.slot_timestamp(k),
+            )
+            for k in range(first, first + self.ahead)
+        ]
+        loop = asyncio.get_running_loop()
+        if self.pool:
+            return loop.run_in_executor(
+                self.pool, _encode_slots, channel.number, frames
+            )
+        encoded = loop.create_future()
+        encoded.set_result(
+            [
+                (timestamp, self.encoder.encode(channel.number, frame, timestamp))
+                for frame, timestamp in frames
+            ]
+        )
+        return encoded
+
     async def frame_stream(self, channel: Channel):
-        """Encode a frame for each Channel.send_frame event into the encoded queue"""
+        """Send a frame into the encoded queue for each Channel.send_frame event
+
+        Frames are encoded a batch at a time, with the next batch encoding while
+        this one is sent, so the event loop only waits on the pool if it falls
+        behind. Batches are awaited in order, keeping the channel's frames in order.
+        Frames for slots the clock has skipped are dropped rather than sent late,
+        so each frame sent carries the timestamp of the slot it is sent in
+        """
         logger.info(
             f"Starting frame stream for channel {channel.number} @ {channel.fps} fps"
         )
-        idx = 0
-        ln = len(channel.frames)
+        pending = deque([(0, self.encode_ahead(channel, 0))])
+        idx = self.ahead
         try:
             while True:
-                await channel.send_frame.wait()
-                channel.send_frame.clear()
-                timestamp = int(time.time_ns() / 1000)
-                frame = channel.frames[idx % ln].data.encode()
-                encoded = self.encoder.encode(channel.number, frame, timestamp)
-                packaged_frame = json.dumps(
-                    {
-                        "channel": channel.number,
-                        "timestamp": timestamp,
-                        "encoded": encoded.hex(),
-                    }
-                )
-                self.encoded_queue.put_nowait(packaged_frame)
-                idx += 1
+                first, encoding = pending.popleft()
+                batch = await encoding
+                # Don't encode slots the clock has already passed
+                idx = max(idx, channel.slot)
+                pending.append((idx, self.encode_ahead(channel, idx)))
+                idx += self.ahead
+                for slot, (timestamp, encoded) in enumerate(batch, first):
+                    await channel.send_frame.wait()
+                    # The clock has moved on past this frame's slot
+                    if slot < channel.slot:
+                        continue
+                    channel.send_frame.clear()
+                    packaged_frame = framing.pack(
+                        channel.number, timestamp, encoded, self.binary
+                    )
+                    self.encoded_queue.put_nowait(packaged_frame)
         except Exception as e:
             logger.critical(f"Frame stream failed for {channel}")
             raise e
 
     async def serve(self):
         """Serve the uplink forever"""
+        if self.workers:
+            self.pool = ProcessPoolExecutor(
+                self.workers, initializer=_init_encoder, initargs=(self.secrets,)
+            )
+            # Bring the processes up before the clocks start, so the first
+            # frames aren't late
+            loop = asyncio.get_running_loop()
+            await asyncio.gather(
+                *(loop.run_in_executor(self.pool, int) for _ in range(self.workers))
+            )
 
         # Spin up all tasks
-        async with asyncio.TaskGroup() as tg:
-            tg.create_task(self.uplink())
-            for channel in self.channels:
-                tg.create_task(self.frame_stream(channel))
-                tg.create_task(channel.frame_clock())
+        try:
+            async with asyncio.TaskGroup() as tg:
+                tg.create_task(self.uplink())
+                for channel in self.channels:
+                    channel.start()
+                    tg.create_task(self.frame_stream(channel))
+                    tg.create_task(channel.frame_clock())
+        finally:
+            if self.pool:
+                self.pool.shutdown(cancel_futures=True)
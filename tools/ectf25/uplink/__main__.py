@@ -13,7 +13,7 @@ Copyright: Copyright (c) 2025 The MITRE Corporation
 import argparse
 import asyncio
 
-from ectf25.uplink import Channel, Uplink
+from ectf25.uplink import Channel, Uplink, at_least
 
 
 async def main():
@@ -30,9 +30,36 @@ async def main():
         help="List of channel:fps:frames_file pairings "
         "(e.g., 1:10:channel1_frames.json 2:20:channel2_frames.json)",
     )
+    parser.add_argument(
+        "--binary",
+        action="store_true",
+        help="Send frames length-prefixed in binary instead of as JSON lines",
+    )
+    parser.add_argument(
+        "--workers",
+        type=at_least(0),
+        help="Processes to encode frames in (default: one per CPU, 0 to encode"
+        " in the main process)",
+    )
+    parser.add_argument(
+        "--ahead",
+        type=at_least(1),
+        default=16,
+        help="Frames each channel encodes at a time, ahead of sending them",
+    )
     args = parser.parse_args()
 
-    await Uplink(args.secrets.read(), args.channels, args.host, args.port).serve()
+    await Uplink(
+        args.secrets.read(),
+        args.channels,
+        args.host,
+        args.port,
+        args.binary,
+        args.workers,
+        args.ahead,
+    ).serve()
 
 
-asyncio.run(main())
+# The encoding processes import this module too
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -13,6 +13,7 @@ Copyright: Copyright (c) 2025 The MITRE Corporation
 from dataclasses import dataclass
 from enum import IntEnum
 import struct
+import weakref
 from typing import Optional, Iterator
 
 from loguru import logger
@@ -21,17 +22,24 @@ from serial.serialutil import SerialTimeoutException
 
 MAGIC = b"%"
 BLOCK_LEN = 256
+# Largest window the Decoder grants, its packet body size
+MAX_WINDOW = 4096
 
 
 class Opcode(IntEnum):
     """Enum class for use in device output processing."""
 
     DECODE = 0x44  # D
+    COMPACT = 0x43  # C
+    BATCH = 0x42  # B
+    ROOT = 0x52  # R
+    PATH = 0x50  # P
     SUBSCRIBE = 0x53  # S
     LIST = 0x4C  # L
     ACK = 0x41  # A
     DEBUG = 0x47  # G
     ERROR = 0x45  # E
+    WINDOW = 0x57  # W
 
 
 NACK_MSGS = {Opcode.DEBUG, Opcode.ACK}
@@ -82,18 +90,75 @@ class Message:
         """Pack the Message into bytes"""
         return self.hdr.pack() + self.body
 
-    def packets(self) -> Iterator[bytes]:
+    def packets(self, block_len: int = BLOCK_LEN) -> Iterator[bytes]:
         """An iterator that chunks the message into blocks to send to the Decoder. An
-        ACK is expected from the Decoder after each block"""
+        ACK is expected from the Decoder after each block
+
+        :param block_len: Bytes sent between ACKs, as negotiated with the Decoder
+        """
         yield self.hdr.pack()
-        for i in range(0, len(self.body), BLOCK_LEN):
-            yield self.body[i : i + BLOCK_LEN]
+        for i in range(0, len(self.body), block_len):
+            yield self.body[i : i + block_len]
 
     def is_ack(self) -> bool:
         """Returns whether the message is an ACK"""
         return self.opcode == Opcode.ACK
 
 
+class RxBuffer:
+    """Bytes received from the Decoder, read in bulk and parsed from the front
+
+    Parsing moves an offset instead of slicing, and garbage before a header is
+    dropped as soon as it is searched, so no byte is searched twice and the
+    consumed prefix is only discarded once it outgrows the unread bytes.
+    """
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.pos = 0
+
+    def __len__(self) -> int:
+        return len(self.buf) - self.pos
+
+    def feed(self, data: bytes):
+        """Append bytes read from the port"""
+        self.buf += data
+
+    def consume(self, n: int):
+        """Drop n unread bytes"""
+        self.pos += n
+        if self.pos > len(self.buf) // 2:
+            del self.buf[: self.pos]
+            self.pos = 0
+
+    def take(self, n: int) -> bytes:
+        """Consume and return the next n bytes, which must have been received"""
+        data = bytes(self.buf[self.pos : self.pos + n])
+        self.consume(n)
+        return data
+
+    def find_header(self) -> Optional[MessageHdr]:
+        """Consume the next complete header, and any garbage before it
+
+        :returns: The header, or None if more bytes are needed
+        """
+        while (i := self.buf.find(MAGIC, self.pos)) >= 0:
+            self.consume(i - self.pos)
+            if len(self) < 4:
+                return None
+            opc, ln = struct.unpack_from("<BH", self.buf, self.pos + 1)
+            try:
+                opcode = Opcode(opc)
+            except ValueError:
+                # A stray magic byte, keep looking after it
+                self.consume(1)
+                continue
+            self.consume(4)
+            return MessageHdr(opcode, ln)
+        self.consume(len(self))
+        return None
+
+
 class DecoderError(Exception):
     pass
 
@@ -106,20 +171,66 @@ class DecoderIntf:
 
     ACK = Message(Opcode.ACK, b"")
 
-    def __init__(self, port, **serial_kwargs):
+    def __init__(
+        self, port, window: int = BLOCK_LEN, pipeline: bool = True, **serial_kwargs
+    ):
         """
         :param port: Serial port to the Decoder
+        :param window: Bytes to send between ACKs. BLOCK_LEN keeps the original
+            protocol; anything larger (up to MAX_WINDOW) is negotiated with the
+            Decoder before the first message, and again after each ERROR or LIST,
+            which put the Decoder back on BLOCK_LEN.
+        :param pipeline: Hold back the ACK ending each response and write it with
+            the next request, or before the next read. The Decoder waits for that
+            ACK before it goes idle and derives keys ahead, so callers that pause
+            between requests should call flush() when they do. Anything held back
+            is also written when the interface is collected or Python exits.
         :param serial_kwargs: Args to pass to the serial interface construction
         """
         self.ser = Serial(baudrate=115200, **serial_kwargs)
         self.ser.port = port
-        self.stream = b""
+        self.rx = RxBuffer()
+        self.tx = bytearray()
+        self.pipeline = pipeline
+        self.window = window
+        self.block_len = BLOCK_LEN
+        # Negotiate self.window before the next message
+        self.renegotiate = window != BLOCK_LEN
+        # Don't leave the Decoder waiting on a held back ACK
+        weakref.finalize(self, self._flush, self.ser, self.tx)
 
     def _open(self):
         """Open the serial connection if not already opened"""
         if not self.ser.is_open:
             self.ser.open()
 
+    def _reset_window(self):
+        """Follow the Decoder back to BLOCK_LEN, as it does on ERROR and LIST"""
+        if self.block_len != BLOCK_LEN:
+            self.block_len = BLOCK_LEN
+            self.renegotiate = True
+
+    def negotiate_window(self, window: int) -> int:
+        """Agree with the Decoder on how many bytes either side sends between ACKs
+
+        Falls back to BLOCK_LEN if the Decoder doesn't support negotiation.
+
+        :param window: Requested window in bytes
+        :returns: The window in use from now on
+        """
+        self.block_len = BLOCK_LEN
+        try:
+            self.send_msg(Message(Opcode.WINDOW, struct.pack("<H", window)))
+            resp = self.get_msg()
+        except DecoderError as e:
+            logger.debug(f"Window negotiation failed ({e}), using {BLOCK_LEN}")
+            return self.block_len
+        if resp.opcode != Opcode.WINDOW or len(resp.body) != 2:
+            raise DecoderError(f"Bad window response {resp}")
+        self.block_len = struct.unpack("<H", resp.body)[0]
+        logger.debug(f"Negotiated window of {self.block_len}")
+        return self.block_len
+
     def decode(self, frame: bytes) -> bytes:
         """Decode a frame
 
@@ -137,6 +248,80 @@ class DecoderIntf:
             raise DecoderError(f"Bad decode response {resp}")
         return resp.body
 
+    def decode_compact(self, frame: bytes) -> bytes:
+        """Decode a frame sent without its nonce
+
+        :param frame: An encoded frame, from Encoder.encode_compact
+        :returns: The decoded frame
+        :raises DecoderError: Error on decode failure
+        """
+        msg = Message(Opcode.COMPACT, frame)
+        self.send_msg(msg)
+
+        resp = self.get_msg()
+        if resp.opcode != Opcode.COMPACT:
+            raise DecoderError(f"Bad compact decode response {resp}")
+        return resp.body
+
+    def decode_batch(self, batch: bytes) -> list[Optional[bytes]]:
+        """Decode a batch of frames
+
+        :param batch: An encoded batch, from Encoder.encode_batch
+        :returns: The decoded frames, in batch order, with None for each frame
+            the Decoder could not decode
+        :raises DecoderError: Error on batch decode failure
+        """
+        # send batch decode message
+        msg = Message(Opcode.BATCH, batch)
+        self.send_msg(msg)
+
+        # receive response
+        resp = self.get_msg()
+        if resp.opcode != Opcode.BATCH or len(resp.body) < 1:
+            raise DecoderError(f"Bad batch decode response {resp}")
+
+        # unpack frame count, then a length byte and data per frame
+        nframes, body = resp.body[0], resp.body[1:]
+        frames = []
+        for _ in range(nframes):
+            if len(body) < 1 or len(body) < 1 + body[0]:
+                raise DecoderError("Bad batch decode response! Truncated frame")
+            flen, body = body[0], body[1:]
+            frames.append(body[:flen] if flen else None)
+            body = body[flen:]
+        if body:
+            raise DecoderError(f"Bad batch decode response! {len(body)} extra bytes")
+
+        return frames
+
+    def send_root(self, root: bytes):
+        """Have the Decoder verify and remember the signed root of a group of frames
+
+        :param root: An encoded root, from Encoder.encode_group
+        :raises DecoderError: Error if the root's signature doesn't verify
+        """
+        msg = Message(Opcode.ROOT, root)
+        self.send_msg(msg)
+
+        resp = self.get_msg()
+        if resp != Message(Opcode.ROOT, b""):
+            raise DecoderError(f"Bad root response {resp}")
+
+    def decode_path(self, frame: bytes) -> bytes:
+        """Decode a frame of a group whose root was sent with send_root
+
+        :param frame: An encoded frame, from Encoder.encode_group
+        :returns: The decoded frame
+        :raises DecoderError: Error on decode failure
+        """
+        msg = Message(Opcode.PATH, frame)
+        self.send_msg(msg)
+
+        resp = self.get_msg()
+        if resp.opcode != Opcode.PATH:
+            raise DecoderError(f"Bad path decode response {resp}")
+        return resp.body
+
     def subscribe(self, subscription: bytes):
         """Subscribe the Decoder to a new subscription
 
@@ -163,6 +348,7 @@ class DecoderIntf:
         # send list message
         msg = Message(Opcode.LIST, b"")
         self.send_msg(msg)
+        self._reset_window()
 
         # receive response
         resp = self.get_msg()
@@ -192,10 +378,57 @@ class DecoderIntf:
 
         return channels
 
+    def perf(self, reset: bool = False) -> bytes:
+        """Query the Decoder's performance counters
+
+        :param reset: Clear the counters once they are reported
+        :returns: The raw counter report, parsed by ectf25.utils.perf
+        :raises DecoderError: Error if the Decoder was built without counters
+        """
+        msg = Message(Opcode.DEBUG, b"\x01" if reset else b"")
+        self.send_msg(msg)
+
+        # The report comes back as a DEBUG, which get_msg would skip
+        resp = self.get_raw_msg()
+        if resp.opcode == Opcode.ERROR:
+            raise DecoderError(f"Decoder returned ERROR: {repr(resp.body)}")
+        if resp.opcode != Opcode.DEBUG:
+            raise DecoderError(f"Bad perf response {resp}")
+        return resp.body
+
     def send_ack(self):
         """Send an ACK to the Decoder"""
         self._open()
-        self.ser.write(self.ACK.pack())
+        self._write(self.ACK.pack())
+
+    def flush(self):
+        """Write any ACK held back by pipelining"""
+        self._flush(self.ser, self.tx)
+
+    @staticmethod
+    def _flush(ser: Serial, tx: bytearray):
+        if tx and ser.is_open:
+            ser.write(tx)
+            tx.clear()
+
+    def _write(self, data: bytes):
+        """Write data, along with anything held back"""
+        if self.tx:
+            data = bytes(self.tx) + data
+            self.tx.clear()
+        self.ser.write(data)
+
+    def _fill(self, n: int):
+        """Read at least n more bytes into the receive buffer, and any more waiting
+
+        :raises SerialTimeoutException: Nothing arrived before the port's timeout
+        """
+        # The Decoder may be waiting on a held back ACK before it sends more
+        self.flush()
+        b = self.ser.read(max(n, self.ser.in_waiting))
+        if b == b"":
+            raise SerialTimeoutException("Read timeout")
+        self.rx.feed(b)
 
     def get_ack(self):
         """Get an expected ACK from the Decoder
@@ -212,11 +445,9 @@ class DecoderIntf:
 
         :returns: The MessageHdr if the parse was successful, None otherwise
         """
-        try:
-            hdr, self.stream = MessageHdr.parse(self.stream)
-        except (ValueError, struct.error):
-            return None
-        logger.debug(f"Found header {hdr}")
+        hdr = self.rx.find_header()
+        if hdr is not None:
+            logger.debug("Found header {}", hdr)
         return hdr
 
     def get_raw_msg(self) -> Message:
@@ -227,32 +458,35 @@ class DecoderIntf:
         """
         self._open()
         while (hdr := self.try_parse()) is None:
-            b = self.ser.read(1)
-            if b == b'':
-                raise SerialTimeoutException('Read timeout')
-            self.stream += b
+            self._fill(4 - len(self.rx))
+        if hdr.opcode == Opcode.ERROR:
+            self._reset_window()
         # Don't ACK an ACK or a debug message
-        if hdr.opcode not in NACK_MSGS:
-            self.send_ack()
-        remaining = hdr.len
-        body = b""
-        while remaining > 0:
-            block = b""
-            while block_remaining := min(BLOCK_LEN, remaining) - len(block):
-                b = self.ser.read(block_remaining)
-                if b == b'':
-                    raise SerialTimeoutException('Read timeout')
-                block += b
-            # Don't ACK an ACK or a debug message
-            if hdr.opcode not in NACK_MSGS:
-                self.send_ack()
-            logger.debug(f"Read block {repr(block)}")
-            body += block
-            remaining -= len(block)
-        msg = Message(hdr.opcode, body)
-        logger.debug(f"Got message {msg}")
+        ack = hdr.opcode not in NACK_MSGS
+        if ack:
+            self._ack(last=hdr.len == 0)
+        body = bytearray()
+        while len(body) < hdr.len:
+            block_len = min(self.block_len, hdr.len - len(body))
+            if len(self.rx) < block_len:
+                self._fill(block_len - len(self.rx))
+            body += self.rx.take(block_len)
+            if ack:
+                self._ack(last=len(body) == hdr.len)
+        msg = Message(hdr.opcode, bytes(body))
+        logger.debug("Got message {}", msg)
         return msg
 
+    def _ack(self, last: bool):
+        """ACK a header or block of a message from the Decoder
+
+        :param last: Whether this ACK ends the message, so may be held back
+        """
+        if last and self.pipeline:
+            self.tx += self.ACK.pack()
+        else:
+            self.send_ack()
+
     def get_msg(self) -> Message:
         """Get a message, handling DEBUG and ERROR messages
 
@@ -265,7 +499,7 @@ class DecoderIntf:
                 raise DecoderError(f"Decoder returned ERROR: {repr(msg.body)}")
             if msg.opcode != Opcode.DEBUG:
                 return msg
-            logger.info(f"Got DEBUG: {repr(msg.body)}")
+            logger.info("Got DEBUG: {!r}", msg.body)
 
     def send_msg(self, msg: Message):
         """Send a message to the Decoder
@@ -274,7 +508,10 @@ class DecoderIntf:
         :raises DecoderError: If unexpected behavior or ERROR message encountered
         """
         self._open()
-        for packet in msg.packets():
-            logger.debug(f"Sending packet {packet}")
-            self.ser.write(packet)
+        if self.renegotiate:
+            self.renegotiate = False
+            self.negotiate_window(self.window)
+        for packet in msg.packets(self.block_len):
+            logger.debug("Sending packet {!r}", packet)
+            self._write(packet)
             self.get_ack()
@@ -0,0 +1,287 @@
+"""
+Decode one frame corpus on many Decoders at once, boards over --ports or host
+simulators spawned with --sim, and report each device's throughput, errors and
+latency percentiles next to the fleet's.
+
+Each device gets its own worker process, so one that hangs or crashes is marked
+failed (or stalled, past --deadline) without holding up the rest.
+"""
+
+import argparse
+import base64
+import json
+import multiprocessing
+import os
+import queue
+import subprocess
+import tempfile
+import time
+from dataclasses import asdict, dataclass, field
+
+from loguru import logger
+from serial.serialutil import SerialException
+
+from ectf25.utils.decoder import DecoderError, DecoderIntf
+
+
+@dataclass
+class DeviceResult:
+    """What one Decoder did with the corpus"""
+
+    port: str
+    status: str = "ok"  # ok, failed (the device stopped answering), stalled
+    frames: int = 0
+    decoded: int = 0
+    errors: int = 0
+    seconds: float = 0.0
+    error: str = ""
+    # Per-frame round trip latencies in microseconds, sorted
+    latencies: list[float] = field(default_factory=list, repr=False)
+
+    @property
+    def fps(self) -> float:
+        return self.frames / self.seconds if self.seconds else 0.0
+
+    @property
+    def error_rate(self) -> float:
+        return self.errors / self.frames if self.frames else 0.0
+
+    def summary(self) -> dict:
+        """The result with latency percentiles in place of the latencies"""
+        summary = asdict(self)
+        del summary["latencies"]
+        for p in (50, 90, 99):
+            summary[f"p{p}_us"] = percentile(self.latencies, p)
+        summary["max_us"] = self.latencies[-1] if self.latencies else 0.0
+        summary["fps"] = self.fps
+        return summary
+
+
+def percentile(latencies: list[float], p: float) -> float:
+    """p-th percentile of sorted latencies, 0 if there are none"""
+    if not latencies:
+        return 0.0
+    return latencies[min(len(latencies) - 1, int(p / 100 * len(latencies)))]
+
+
+def run_device(port: str, frames: list[bytes], subscriptions: list[bytes], args, out):
+    """Worker: decode the corpus on one Decoder and put a DeviceResult on out
+
+    Runs in its own process, so a device that hangs or crashes its worker only
+    takes itself down, and the host side of the protocol scales across cores.
+    """
+    result = DeviceResult(port)
+    start = time.perf_counter()
+    try:
+        decoder = DecoderIntf(port, timeout=args.timeout, write_timeout=args.timeout)
+        for subscription in subscriptions:
+            decoder.subscribe(subscription)
+
+        start = time.perf_counter()
+        for frame in frames:
+            t = time.perf_counter()
+            try:
+                decoder.decode(frame)
+                result.decoded += 1
+            except DecoderError:
+                result.errors += 1
+            result.latencies.append((time.perf_counter() - t) * 1e6)
+            result.frames += 1
+    except (SerialException, DecoderError, OSError) as e:
+        # Timeouts land here too: the device stopped answering mid-message
+        result.status = "failed"
+        result.error = repr(e)
+
+    # Report what a failed device got through as well
+    result.seconds = time.perf_counter() - start
+    result.latencies.sort()
+    out.put(result)
+
+
+def spawn_simulators(binary: str, count: int, workdir: str) -> tuple[list, list[str]]:
+    """Start count host Decoder simulators, each with its own flash and pty
+
+    :returns: The simulator processes and their ports
+    """
+    procs, ports = [], []
+    for i in range(count):
+        port = os.path.join(workdir, f"decoder{i}")
+        env = dict(
+            os.environ,
+            DECODER_FLASH=os.path.join(workdir, f"decoder{i}.bin"),
+            DECODER_PTY_LINK=port,
+        )
+        procs.append(
+            subprocess.Popen(
+                [binary], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
+            )
+        )
+        ports.append(port)
+
+    deadline = time.monotonic() + 10
+    while not all(os.path.exists(port) for port in ports):
+        if time.monotonic() > deadline:
+            raise RuntimeError("Simulators didn't come up")
+        time.sleep(0.05)
+    return procs, ports
+
+
+def run_fleet(ports: list[str], frames: list[bytes], subscriptions: list[bytes], args):
+    """Decode the corpus on every Decoder at once
+
+    :returns: A DeviceResult per port, in port order, and the wall clock seconds
+    """
+    out = multiprocessing.Queue()
+    workers = {
+        port: multiprocessing.Process(
+            target=run_device, args=(port, frames, subscriptions, args, out)
+        )
+        for port in ports
+    }
+    start = time.monotonic()
+    for worker in workers.values():
+        worker.start()
+
+    # Collect results as devices finish, giving up on any past the deadline
+    results = {}
+    deadline = start + args.deadline if args.deadline else float("inf")
+    while len(results) < len(ports):
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            break
+        try:
+            result = out.get(timeout=min(1, remaining))
+            results[result.port] = result
+            logger.info(
+                f"{result.port}: {result.status}, {result.decoded}/{result.frames}"
+                f" frames in {result.seconds:.2f}s"
+            )
+        except queue.Empty:
+            # A worker that died without reporting won't report later
+            for port, worker in workers.items():
+                if port not in results and not worker.is_alive() and out.empty():
+                    results[port] = DeviceResult(
+                        port, "failed", error=f"worker exited {worker.exitcode}"
+                    )
+    wall = time.monotonic() - start
+
+    for port, worker in workers.items():
+        if port not in results:
+            logger.error(f"{port}: no result after {args.deadline}s, stopping it")
+            worker.terminate()
+            results[port] = DeviceResult(port, "stalled", error="deadline passed")
+        worker.join()
+    return [results[port] for port in ports], wall
+
+
+def report(results: list[DeviceResult], wall: float) -> dict:
+    """Aggregate the devices' results"""
+    latencies = sorted(lat for r in results for lat in r.latencies)
+    frames = sum(r.frames for r in results)
+    return {
+        "devices": len(results),
+        "ok": sum(r.status == "ok" for r in results),
+        "frames": frames,
+        "decoded": sum(r.decoded for r in results),
+        "errors": sum(r.errors for r in results),
+        "seconds": wall,
+        "fps": frames / wall if wall else 0.0,
+        "p50_us": percentile(latencies, 50),
+        "p90_us": percentile(latencies, 90),
+        "p99_us": percentile(latencies, 99),
+        "max_us": latencies[-1] if latencies else 0.0,
+    }
+
+
+def render(results: list[DeviceResult], total: dict) -> str:
+    """Render a table with a row per device, then the fleet's totals"""
+    lines = [
+        f"{'port':<24} {'status':<8} {'frames':>8} {'err%':>6} {'fps':>8} "
+        f"{'p50':>8} {'p90':>8} {'p99':>8} {'max':>8}   (us)"
+    ]
+    for r in results:
+        s = r.summary()
+        lines.append(
+            f"{r.port[-24:]:<24} {r.status:<8} {r.frames:>8}"
+            f" {100 * r.error_rate:>6.2f} {r.fps:>8.1f} {s['p50_us']:>8.0f}"
+            f" {s['p90_us']:>8.0f} {s['p99_us']:>8.0f} {s['max_us']:>8.0f}"
+            + (f"  {r.error}" if r.error else "")
+        )
+    err = 100 * total["errors"] / total["frames"] if total["frames"] else 0
+    lines.append(
+        f"{'fleet':<24} {total['ok']:>3}/{total['devices']:<4} {total['frames']:>8}"
+        f" {err:>6.2f} {total['fps']:>8.1f} {total['p50_us']:>8.0f}"
+        f" {total['p90_us']:>8.0f} {total['p99_us']:>8.0f} {total['max_us']:>8.0f}"
+    )
+    return "\n".join(lines)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(prog="ectf25.utils.fleet")
+    parser.add_argument(
+        "frames",
+        type=argparse.FileType("r"),
+        help="JSON list of base64-encoded frames (can be created by"
+        " `stress_test encode --dump`), decoded in order on every device",
+    )
+    devices = parser.add_mutually_exclusive_group(required=True)
+    devices.add_argument("--ports", nargs="+", help="Serial ports to the Decoders")
+    devices.add_argument(
+        "--sim",
+        metavar="BINARY",
+        help="Run --count host simulators (decoder/host/build/decoder_sim) instead",
+    )
+    parser.add_argument(
+        "--count", "-n", type=int, default=4, help="Number of simulators to run"
+    )
+    parser.add_argument(
+        "--subscribe",
+        nargs="+",
+        type=argparse.FileType("rb"),
+        default=[],
+        help="Subscription files to send every device first",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        default=5,
+        help="Seconds without an answer before a device is marked failed",
+    )
+    parser.add_argument(
+        "--deadline",
+        type=float,
+        default=0,
+        help="Seconds before devices still running are stopped (0 for no limit)",
+    )
+    parser.add_argument(
+        "--json", type=argparse.FileType("w"), help="Also write the report here"
+    )
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    frames = [base64.b64decode(frame[1]) for frame in json.load(args.frames)]
+    subscriptions = [f.read() for f in args.subscribe]
+
+    with tempfile.TemporaryDirectory() as workdir:
+        procs, ports = [], args.ports
+        if args.sim:
+            procs, ports = spawn_simulators(args.sim, args.count, workdir)
+        logger.info(f"Decoding {len(frames)} frames on each of {len(ports)} devices")
+        try:
+            results, wall = run_fleet(ports, frames, subscriptions, args)
+        finally:
+            for proc in procs:
+                proc.terminate()
+                proc.wait()
+
+    total = report(results, wall)
+    print(render(results, total))
+    if args.json:
+        devices = [r.summary() for r in results]
+        json.dump({"fleet": total, "devices": devices}, args.json, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,189 @@
+"""
+Framing of encoded frames from the Uplink through the Satellite to the TVs.
+
+A message is either a JSON line, {"channel": int, "timestamp": int, "encoded":
+hex}\n, or binary: a 16 byte little-endian header of the magic byte 0xec, the
+encoded frame's length (u16), the channel (u32) and the timestamp (u64),
+followed by the encoded frame. JSON always starts with "{", so readers tell the
+two apart by the first byte of each message, and the Satellite can route binary
+messages on the channel at a fixed offset without parsing anything else.
+
+Run as a module to benchmark each hop's framing work in both formats.
+"""
+
+import argparse
+import asyncio
+import binascii
+import json
+import socket
+import struct
+import threading
+import time
+from typing import BinaryIO
+
+MAGIC = b"\xec"
+HEADER = struct.Struct("<cHIQ")  # magic, encoded length, channel, timestamp
+CHANNEL = struct.Struct("<I")
+MAX_ENCODED_LEN = 0xFFFF  # the header's u16 length
+# The Satellite routes on the channel without parsing anything else
+CHANNEL_OFFSET = 3
+
+HOPS = ("uplink", "satellite", "tv")
+
+
+def pack(channel: int, timestamp: int, encoded: bytes, binary: bool) -> bytes:
+    """Package an encoded frame for the wire
+
+    :raises ValueError: The frame is too long for the binary header's length
+    """
+    if binary:
+        if len(encoded) > MAX_ENCODED_LEN:
+            raise ValueError(
+                f"Encoded frame of {len(encoded)} bytes is longer than the"
+                f" {MAX_ENCODED_LEN} bytes binary framing allows"
+            )
+        return HEADER.pack(MAGIC, len(encoded), channel, timestamp) + encoded
+    frame = {"channel": channel, "timestamp": timestamp, "encoded": encoded.hex()}
+    return json.dumps(frame).encode() + b"\n"
+
+
+def unpack(message: bytes) -> tuple[int, int, bytes]:
+    """Unpack a message from read_message
+
+    :returns: The channel, timestamp and encoded frame
+    """
+    if message[:1] == MAGIC:
+        _, _, channel, timestamp = HEADER.unpack_from(message)
+        return channel, timestamp, message[HEADER.size :]
+    frame = json.loads(message)
+    return frame["channel"], frame["timestamp"], binascii.a2b_hex(frame["encoded"])
+
+
+def channel_of(message: bytes) -> int:
+    """The channel of a message from read_message, without unpacking the rest"""
+    if message[:1] == MAGIC:
+        return CHANNEL.unpack_from(message, CHANNEL_OFFSET)[0]
+    return json.loads(message)["channel"]
+
+
+def read_message(stream: BinaryIO) -> bytes:
+    """Read one message of either framing from a buffered stream
+
+    :raises EOFError: The stream ended
+    """
+    first = stream.read(1)
+    if first == MAGIC:
+        header = first + stream.read(HEADER.size - 1)
+        if len(header) < HEADER.size:
+            raise EOFError("Stream ended mid-frame")
+        encoded = stream.read(_encoded_len(header))
+        if len(encoded) < _encoded_len(header):
+            raise EOFError("Stream ended mid-frame")
+        return header + encoded
+    line = first + stream.readline()
+    if not line.endswith(b"\n"):
+        raise EOFError("Stream ended")
+    return line
+
+
+async def read_message_async(reader: asyncio.StreamReader) -> bytes:
+    """Read one message of either framing from an asyncio stream
+
+    :raises asyncio.IncompleteReadError: The stream ended
+    """
+    first = await reader.readexactly(1)
+    if first == MAGIC:
+        header = first + await reader.readexactly(HEADER.size - 1)
+        return header + await reader.readexactly(_encoded_len(header))
+    line = first + await reader.readline()
+    if not line.endswith(b"\n"):
+        raise asyncio.IncompleteReadError(line, None)
+    return line
+
+
+def _encoded_len(header: bytes) -> int:
+    return struct.unpack_from("<H", header, 1)[0]
+
+
+def bench(n: int, binary: bool, encoded_len: int = 168) -> dict[str, float]:
+    """Frames/s of each hop's framing work, over local sockets
+
+    Each hop runs on its own: the Uplink packs and sends, the Satellite reads
+    and routes on the channel, and the TV reads and unpacks, with a thread
+    feeding it ready-made messages or draining what it sends as needed.
+    """
+    encoded = bytes(range(256))[:encoded_len]
+    stream = b"".join(pack(i % 4, i, encoded, binary) for i in range(n))
+
+    def uplink(_, tx: socket.socket):
+        with tx.makefile("wb") as f:
+            for i in range(n):
+                f.write(pack(i % 4, i, encoded, binary))
+
+    async def route(rx: socket.socket, tx: socket.socket):
+        # Keep the writer referenced, collecting it closes the connection
+        reader, writer = await asyncio.open_connection(sock=rx)
+        with tx.makefile("wb") as f:
+            for _ in range(n):
+                message = await read_message_async(reader)
+                if channel_of(message) < 4:
+                    f.write(message)
+        writer.close()
+
+    def satellite(rx: socket.socket, tx: socket.socket):
+        asyncio.run(route(rx, tx))
+
+    def tv(rx: socket.socket, _):
+        with rx.makefile("rb") as f:
+            for i in range(n):
+                assert unpack(read_message(f)) == (i % 4, i, encoded)
+
+    def feed(sock: socket.socket):
+        sock.sendall(stream)
+        sock.shutdown(socket.SHUT_WR)
+
+    def drain(sock: socket.socket):
+        while sock.recv(1 << 16):
+            pass
+
+    def timed(hop, reads: bool) -> float:
+        feed_tx, rx = socket.socketpair()
+        tx, drain_rx = socket.socketpair()
+        threads = [threading.Thread(target=drain, args=(drain_rx,))]
+        if reads:
+            threads.append(threading.Thread(target=feed, args=(feed_tx,)))
+        for thread in threads:
+            thread.start()
+        start = time.perf_counter()
+        hop(rx, tx)
+        elapsed = time.perf_counter() - start
+        tx.shutdown(socket.SHUT_WR)
+        for thread in threads:
+            thread.join()
+        for sock in (feed_tx, rx, tx, drain_rx):
+            sock.close()
+        return elapsed
+
+    return {
+        "bytes": len(stream) / n,
+        "uplink": n / timed(uplink, reads=False),
+        "satellite": n / timed(satellite, reads=True),
+        "tv": n / timed(tv, reads=True),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="ectf25.utils.framing")
+    parser.add_argument("-n", type=int, default=100_000, help="Frames to send")
+    args = parser.parse_args()
+
+    for binary in (False, True):
+        result = bench(args.n, binary)
+        print(
+            f"{'binary' if binary else 'json':<6} {result['bytes']:>4.0f} B/frame"
+            + "".join(f"  {hop} {result[hop]:>9,.0f}/s" for hop in HOPS)
+        )
+
+
+if __name__ == "__main__":
+    main()
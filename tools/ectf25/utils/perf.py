@@ -0,0 +1,136 @@
+"""
+Report a Decoder's performance counters: per-phase timing histograms of packet
+handling, plus its KDF cache and key prediction counters.
+
+The counters are only in Decoders built with PERF_COUNTERS=1 (the default for
+the host simulator, see decoder/project.mk); others answer the query with an
+error.
+"""
+
+import argparse
+import struct
+from dataclasses import dataclass
+
+from ectf25.utils.decoder import DecoderError, DecoderIntf
+
+# Phases in the order of perf_phase_t in decoder/inc/perf.h
+PHASES = ["header", "body", "verify", "lookup", "derive", "decrypt", "send"]
+COUNTERS = [
+    "kdf_hits",
+    "kdf_misses",
+    "kdf_digests",
+    "predict_hits",
+    "predict_misses",
+    "predict_derived",
+]
+BAR_WIDTH = 30
+
+
+@dataclass
+class Histogram:
+    """Durations of one phase, in the Decoder's cycle counter ticks
+
+    buckets[i] counts durations in [2^i, 2^(i+1)) ticks
+    """
+
+    count: int
+    total: int
+    max: int
+    buckets: list[int]
+
+    def percentile(self, p: float) -> int:
+        """Upper bound of the bucket holding the p-th percentile, in ticks"""
+        target = p / 100 * self.count
+        seen = 0
+        for i, n in enumerate(self.buckets):
+            seen += n
+            if n and seen >= target:
+                return min(2 ** (i + 1) - 1, self.max)
+        return self.max
+
+
+@dataclass
+class PerfReport:
+    """A perf_report_t, see decoder/inc/perf.h"""
+
+    ticks_per_us: int
+    phases: dict[str, Histogram]
+    counters: dict[str, int]
+
+    @classmethod
+    def parse(cls, body: bytes) -> "PerfReport":
+        ticks_per_us, n_phases, n_buckets = struct.unpack_from("<IBB", body)
+        offset = struct.calcsize("<IBB")
+        hist_fmt = f"<IQI{n_buckets}I"
+        expected = offset + n_phases * struct.calcsize(hist_fmt) + 4 * len(COUNTERS)
+        if len(body) != expected:
+            raise DecoderError(
+                f"Bad perf report! Expected len {expected}, got {len(body)}"
+            )
+
+        phases = {}
+        for i in range(n_phases):
+            count, total, max_, *buckets = struct.unpack_from(hist_fmt, body, offset)
+            offset += struct.calcsize(hist_fmt)
+            name = PHASES[i] if i < len(PHASES) else f"phase{i}"
+            phases[name] = Histogram(count, total, max_, buckets)
+
+        values = struct.unpack_from(f"<{len(COUNTERS)}I", body, offset)
+        return cls(ticks_per_us, phases, dict(zip(COUNTERS, values)))
+
+    def us(self, ticks: int) -> float:
+        return ticks / self.ticks_per_us
+
+    def render(self) -> str:
+        """Render a table of the phases, then each phase's histogram"""
+        lines = [
+            f"{'phase':<8} {'count':>8} {'mean':>10} {'p50':>10} {'p90':>10} "
+            f"{'p99':>10} {'max':>10}   (us)"
+        ]
+        for name, h in self.phases.items():
+            if not h.count:
+                lines.append(f"{name:<8} {0:>8}")
+                continue
+            stats = [h.total / h.count] + [h.percentile(p) for p in (50, 90, 99)]
+            stats.append(h.max)
+            lines.append(
+                f"{name:<8} {h.count:>8} "
+                + " ".join(f"{self.us(t):>10.1f}" for t in stats)
+            )
+
+        for name, h in self.phases.items():
+            if not h.count:
+                continue
+            lines.append(f"\n{name}:")
+            peak = max(h.buckets)
+            for i, n in enumerate(h.buckets):
+                if not n:
+                    continue
+                bar = "#" * max(1, round(n / peak * BAR_WIDTH))
+                lines.append(f"  < {self.us(2 ** (i + 1)):>10.1f} us {n:>8} {bar}")
+
+        lines.append("")
+        lines += [f"{name:<16} {value:>8}" for name, value in self.counters.items()]
+        return "\n".join(lines)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(prog="ectf25.utils.perf")
+    parser.add_argument(
+        "port", help="Serial port to the Decoder (see https://rules.ectf.mitre.org/)"
+    )
+    parser.add_argument(
+        "--reset", action="store_true", help="Clear the counters once reported"
+    )
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    decoder = DecoderIntf(args.port)
+    report = PerfReport.parse(decoder.perf(args.reset))
+    print(report.render())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,193 @@
+"""
+Load test the Satellite's per-TV queues: a fast local Uplink feeds a Satellite
+serving one TV that keeps up and one that sleeps --delay after each frame, with
+a small receive buffer so the backlog lands in the Satellite's queue.
+
+Prints each second's traced heap and both TVs' frames, queue depth, drops and
+latency, then the heap's range once the slow TV's queue has filled.
+"""
+
+import argparse
+import asyncio
+import socket
+import time
+import tracemalloc
+
+from loguru import logger
+
+from ectf25.satellite import Channel, Policy, Satellite, queue_len_ty
+from ectf25.utils import framing
+
+HOST = "127.0.0.1"
+CHANNEL = 1
+
+
+def free_port() -> int:
+    with socket.socket() as s:
+        s.bind((HOST, 0))
+        return s.getsockname()[1]
+
+
+class Load:
+    """A Satellite fed by a fast Uplink, with a TV that keeps up and one that doesn't
+
+    Everything runs in this process over local sockets, so the memory it holds
+    on to is the Satellite's (and the sockets')
+    """
+
+    def __init__(self, args):
+        self.args = args
+        self.encoded = bytes(args.frame_size)
+        self.received = {"fast": 0, "slow": 0}
+        self.slow_done = ""
+        self.stopped = False
+
+    async def uplink(self, _, writer: asyncio.StreamWriter):
+        """Publish frames at --fps, in bursts every 10ms"""
+        burst = max(1, self.args.fps // 100)
+        timestamp = 0
+        while not self.stopped:
+            for _ in range(burst):
+                timestamp += 1
+                writer.write(
+                    framing.pack(CHANNEL, timestamp, self.encoded, binary=True)
+                )
+            await writer.drain()
+            await asyncio.sleep(burst / self.args.fps)
+
+    async def connect(self, port: int, rcvbuf: int = 0) -> asyncio.StreamReader:
+        sock = socket.socket()
+        if rcvbuf:
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+        sock.setblocking(False)
+        await asyncio.get_running_loop().sock_connect(sock, (HOST, port))
+        reader, self.writers[port, rcvbuf] = await asyncio.open_connection(sock=sock)
+        return reader
+
+    async def tv(self, name: str, port: int, delay: float, rcvbuf: int = 0):
+        """Read frames, sleeping delay seconds after each, checking their order"""
+        reader = await self.connect(port, rcvbuf)
+        last = 0
+        try:
+            while True:
+                message = await framing.read_message_async(reader)
+                _, timestamp, _ = framing.unpack(message)
+                if timestamp <= last:
+                    raise RuntimeError(f"{name} TV got {timestamp} after {last}!")
+                last = timestamp
+                self.received[name] += 1
+                if delay:
+                    await asyncio.sleep(delay)
+        except (asyncio.IncompleteReadError, ConnectionResetError):
+            if not self.stopped:
+                self.slow_done = (
+                    f"{name} TV disconnected after {self.received[name]} frames,"
+                    f" at {time.monotonic() - self.start:.1f}s"
+                )
+
+    async def run(self):
+        args = self.args
+        self.writers = {}
+        tracemalloc.start()
+
+        up = await asyncio.start_server(self.uplink, HOST, 0)
+        up_port = up.sockets[0].getsockname()[1]
+        down_port = free_port()
+        satellite = Satellite(
+            {CHANNEL: Channel(CHANNEL, HOST, down_port)},
+            HOST,
+            up_port,
+            args.queue_len,
+            args.policy,
+        )
+        tasks = [asyncio.create_task(satellite.serve())]
+        await asyncio.sleep(0.5)
+        self.start = time.monotonic()
+        tasks += [
+            asyncio.create_task(self.tv("fast", down_port, 0)),
+            asyncio.create_task(self.tv("slow", down_port, args.delay, 4096)),
+        ]
+
+        print(
+            f"{'t':>4} {'heap KiB':>9}  {'slow TV':>8} {'depth':>6} {'drops':>8}"
+            f" {'ms':>7}  {'fast TV':>8} {'depth':>6} {'ms':>7}"
+        )
+        heap = []
+        full = 0  # When the slow TV's queue first filled up
+        for t in range(1, args.seconds + 1):
+            await asyncio.sleep(self.start + t - time.monotonic())
+            heap.append(tracemalloc.get_traced_memory()[0] / 1024)
+            # The fast TV connected first, so its name sorts first
+            stats = satellite.stats(reset=True)
+            fast = stats[0] if stats else {}
+            slow = stats[1] if len(stats) > 1 else {}
+            if not full and (slow.get("max_depth") == args.queue_len or not slow):
+                full = t
+            print(
+                f"{t:>4} {heap[-1]:>9.0f}  {self.received['slow']:>8}"
+                f" {slow.get('depth', '-'):>6} {slow.get('drops', '-'):>8}"
+                f" {slow.get('latency_ms', 0):>7.1f}  {self.received['fast']:>8}"
+                f" {fast.get('depth', '-'):>6} {fast.get('latency_ms', 0):>7.1f}"
+            )
+
+        # Hang up the TVs, then give every handler a moment to see it
+        self.stopped = True
+        for writer in self.writers.values():
+            writer.close()
+        await asyncio.sleep(0.1)
+        for task in tasks:
+            task.cancel()
+        await asyncio.gather(*tasks, return_exceptions=True)
+        up.close()
+        await up.wait_closed()
+        await asyncio.sleep(0.1)
+
+        if self.slow_done:
+            print(self.slow_done)
+        # The sockets' buffers take a while to fill, before the queue does
+        if full:
+            steady = heap[full - 1 :]
+            print(
+                f"heap from {full}s on, once the slow TV's queue filled:"
+                f" {min(steady):.0f} to {max(steady):.0f} KiB"
+            )
+        else:
+            print("The slow TV's queue never filled, try a longer --seconds")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        prog="ectf25.utils.slow_tv",
+        description="Load test the Satellite with one TV that can't keep up",
+    )
+    parser.add_argument("--seconds", type=int, default=30, help="Test length")
+    parser.add_argument("--fps", type=int, default=2000, help="Uplink frame rate")
+    parser.add_argument("--frame-size", type=int, default=168, help="Encoded size")
+    parser.add_argument(
+        "--delay", type=float, default=0.01, help="Slow TV's seconds per frame"
+    )
+    parser.add_argument(
+        "--queue-len",
+        type=queue_len_ty,
+        default=64,
+        help="Satellite's per-TV queue length",
+    )
+    parser.add_argument(
+        "--policy",
+        type=Policy,
+        default=Policy.DROP_OLDEST,
+        choices=list(Policy),
+        metavar="{" + ",".join(p.value for p in Policy) + "}",
+        help="Satellite's policy for the slow TV",
+    )
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    logger.remove()
+    asyncio.run(Load(args).run())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,156 @@
+"""
+Measure the FPS each channel of the Uplink sustains as the number of channels
+grows, with its frames encoded on the event loop or in a pool of processes.
+
+Each measurement runs an Uplink with the binary framing in this process and
+counts the frames a local consumer receives per channel, along with how often a
+channel's frame clock found its last frame still unsent.
+"""
+
+import argparse
+import asyncio
+import os
+import socket
+import time
+from collections import Counter
+
+from loguru import logger
+
+from ectf25.uplink import Channel, Frame, Uplink, at_least
+from ectf25.utils import framing
+
+HOST = "127.0.0.1"
+
+
+def free_port() -> int:
+    with socket.socket() as s:
+        s.bind((HOST, 0))
+        return s.getsockname()[1]
+
+
+async def consume(port: int, counts: Counter, started: asyncio.Event):
+    """Count the frames the Uplink sends per channel"""
+    while True:
+        try:
+            reader, writer = await asyncio.open_connection(HOST, port)
+            break
+        except OSError:
+            await asyncio.sleep(0.05)
+    started.set()
+    try:
+        while True:
+            message = await framing.read_message_async(reader)
+            counts[framing.channel_of(message)] += 1
+    finally:
+        writer.close()
+
+
+async def measure(args, channels: int, workers: int) -> tuple[list[float], int]:
+    """Run an Uplink with channels channels at --fps each
+
+    :returns: Each channel's sustained FPS, and how many times a channel's clock
+        found it hadn't sent its last frame yet
+    """
+    frames = [Frame(0, "x" * args.frame_size, 0)]
+    port = free_port()
+    uplink = Uplink(
+        args.secrets,
+        [Channel(number, args.fps, frames) for number in range(1, channels + 1)],
+        HOST,
+        port,
+        binary=True,
+        workers=workers,
+        ahead=args.ahead,
+    )
+    late = Counter()
+    sink = logger.add(
+        lambda _: late.update(["late"]),
+        filter=lambda record: "not meeting FPS" in record["message"],
+    )
+
+    counts, started = Counter(), asyncio.Event()
+    tasks = [asyncio.create_task(uplink.serve())]
+    tasks.append(asyncio.create_task(consume(port, counts, started)))
+    await started.wait()
+
+    # Skip the first second, while the pool comes up
+    await asyncio.sleep(1)
+    before, late_before = counts.copy(), late["late"]
+    start = time.monotonic()
+    await asyncio.sleep(args.seconds)
+    elapsed = time.monotonic() - start
+    fps = [
+        (counts[number] - before[number]) / elapsed for number in range(1, channels + 1)
+    ]
+    missed = late["late"] - late_before
+
+    # Hang up first, so the Uplink's connection handler sees it and returns
+    tasks[1].cancel()
+    await asyncio.sleep(0.1)
+    tasks[0].cancel()
+    await asyncio.gather(*tasks, return_exceptions=True)
+    logger.remove(sink)
+    return fps, missed
+
+
+async def run(args):
+    print(
+        f"{'channels':>8} {'workers':>7} {'target':>7} {'min fps':>8} {'mean fps':>9}"
+        f" {'total fps':>10} {'late':>6}"
+    )
+    for channels in args.channels:
+        for workers in args.workers:
+            fps, missed = await measure(args, channels, workers)
+            print(
+                f"{channels:>8} {workers:>7} {args.fps:>7} {min(fps):>8.1f}"
+                f" {sum(fps) / len(fps):>9.1f} {sum(fps):>10.1f} {missed:>6}"
+            )
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        prog="ectf25.utils.uplink_bench",
+        description="Measure the FPS each channel of the Uplink sustains as the"
+        " number of channels grows",
+    )
+    parser.add_argument(
+        "secrets",
+        type=argparse.FileType("rb"),
+        help="Path to a secrets file with channels 1 to the most --channels",
+    )
+    parser.add_argument(
+        "--channels",
+        nargs="+",
+        type=int,
+        default=[1, 4, 16, 64],
+        help="Channel counts to measure",
+    )
+    parser.add_argument(
+        "--workers",
+        nargs="+",
+        type=at_least(0),
+        default=[0, os.cpu_count()],
+        help="Encoding process counts to measure (0 encodes on the event loop)",
+    )
+    parser.add_argument("--fps", type=int, default=100, help="Target FPS per channel")
+    parser.add_argument("--seconds", type=float, default=5, help="Per measurement")
+    parser.add_argument(
+        "--ahead",
+        type=at_least(1),
+        default=16,
+        help="Uplink's frames encoded at a time",
+    )
+    parser.add_argument("--frame-size", type=int, default=64, help="Frame size")
+    args = parser.parse_args()
+    args.secrets = args.secrets.read()
+    return args
+
+
+def main():
+    args = parse_args()
+    logger.remove()
+    asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+    main()